@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.power@1.3-service.pixel-libperfmgr"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <utils/Log.h>
+
+#include <android-base/parseint.h>
+#include <android-base/strings.h>
+
+#include "DisplayIdleSource.h"
+
+#define MAX_LENGTH 64
+
+#define NSINMS 1000000L
+#define NSINSEC 1000000000L
+
+static constexpr int32_t kDefaultVsyncIdleMs = 100;
+
+static const std::vector<std::string> fb_idle_patch = {"/sys/class/drm/card0/device/idle_state",
+                                                       "/sys/class/graphics/fb0/idle_state"};
+
+std::unique_ptr<DisplayIdleSource> CreateDisplayIdleSource(const std::string &config) {
+    std::unique_ptr<DisplayIdleSource> source;
+    const std::vector<std::string> fields = android::base::Split(config, ":");
+    if (config.empty()) {
+        source = SysfsIdleSource::Open(fb_idle_patch);
+    } else if (fields[0] == "sysfs" && fields.size() == 2) {
+        source = SysfsIdleSource::Open({fields[1]});
+    } else if (fields[0] == "vsync" && (fields.size() == 2 || fields.size() == 3)) {
+        int32_t idle_ms = kDefaultVsyncIdleMs;
+        if (fields.size() == 3 && !android::base::ParseInt(fields[2], &idle_ms, 1)) {
+            ALOGE("%s: invalid idle time in %s", __func__, config.c_str());
+        } else {
+            source = VsyncIdleSource::Open(fields[1], idle_ms);
+        }
+    } else if (config != "timer") {
+        ALOGE("%s: invalid display idle source %s", __func__, config.c_str());
+    }
+    if (!source) {
+        ALOGW("%s: no display idle signal, interaction boosts run to their timeout", __func__);
+        source = std::make_unique<TimerIdleSource>();
+    }
+    return source;
+}
+
+std::unique_ptr<SysfsIdleSource> SysfsIdleSource::Open(const std::vector<std::string> &paths) {
+    for (const auto &path : paths) {
+        android::base::unique_fd fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+        if (fd >= 0)
+            return std::unique_ptr<SysfsIdleSource>(new SysfsIdleSource(std::move(fd)));
+    }
+    ALOGE("Unable to open fb idle state path (%d)", errno);
+    return nullptr;
+}
+
+enum display_idle_state SysfsIdleSource::ReadState() {
+    char data[MAX_LENGTH];
+    // Reading the node also rearms the notification
+    ssize_t ret = pread(mFd, data, sizeof(data), 0);
+    if (ret <= 0) {
+        ALOGE("%s: Unexpected EOF!", __func__);
+        return DISPLAY_IDLE_STATE_ERROR;
+    }
+    return strncmp(data, "idle", 4) ? DISPLAY_IDLE_STATE_BUSY : DISPLAY_IDLE_STATE_IDLE;
+}
+
+short SysfsIdleSource::GetEvents() const {
+    return POLLPRI | POLLERR;
+}
+
+std::unique_ptr<VsyncIdleSource> VsyncIdleSource::Open(const std::string &path, int32_t idle_ms) {
+    android::base::unique_fd fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        ALOGE("Unable to open vsync timestamp path %s (%d)", path.c_str(), errno);
+        return nullptr;
+    }
+    android::base::unique_fd timer_fd(
+            timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC));
+    if (timer_fd < 0) {
+        ALOGE("Unable to create timer fd (%d)", errno);
+        return nullptr;
+    }
+    return std::unique_ptr<VsyncIdleSource>(
+            new VsyncIdleSource(std::move(fd), std::move(timer_fd), idle_ms));
+}
+
+enum display_idle_state VsyncIdleSource::ReadState() {
+    uint64_t expirations;
+    // Nothing to read unless the timer fired
+    if (read(mTimerFd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+        ALOGE("%s: failed to read timer fd (%d)", __func__, errno);
+        return DISPLAY_IDLE_STATE_ERROR;
+    }
+
+    // e.g. "VSYNC=1234567890" or "1234567890"
+    char data[MAX_LENGTH];
+    ssize_t ret = pread(mFd, data, sizeof(data) - 1, 0);
+    if (ret <= 0) {
+        ALOGE("%s: Unexpected EOF!", __func__);
+        return DISPLAY_IDLE_STATE_ERROR;
+    }
+    data[ret] = '\0';
+    const char *value = strchr(data, '=');
+    const int64_t vsync_ns = strtoll(value ? value + 1 : data, nullptr, 10);
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const int64_t idle_ns = vsync_ns + static_cast<int64_t>(mIdleMs) * NSINMS;
+    if (static_cast<int64_t>(now.tv_sec) * NSINSEC + now.tv_nsec >= idle_ns) {
+        return DISPLAY_IDLE_STATE_IDLE;
+    }
+
+    // Check again when the display would be idle without further vsync
+    struct itimerspec timer = {};
+    timer.it_value.tv_sec = idle_ns / NSINSEC;
+    timer.it_value.tv_nsec = idle_ns % NSINSEC;
+    if (timerfd_settime(mTimerFd, TFD_TIMER_ABSTIME, &timer, nullptr) < 0) {
+        ALOGE("%s: failed to arm timer fd (%d)", __func__, errno);
+        return DISPLAY_IDLE_STATE_ERROR;
+    }
+    return DISPLAY_IDLE_STATE_BUSY;
+}
+
+short VsyncIdleSource::GetEvents() const {
+    return POLLIN;
+}
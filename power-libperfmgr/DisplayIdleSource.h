@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef POWER_LIBPERFMGR_DISPLAYIDLESOURCE_H_
+#define POWER_LIBPERFMGR_DISPLAYIDLESOURCE_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <android-base/unique_fd.h>
+
+enum display_idle_state {
+    DISPLAY_IDLE_STATE_ERROR = -1,
+    DISPLAY_IDLE_STATE_BUSY = 0,
+    DISPLAY_IDLE_STATE_IDLE,
+};
+
+// Tells InteractionHandler when the display goes idle after an interaction.
+class DisplayIdleSource {
+  public:
+    virtual ~DisplayIdleSource() {}
+    // Read the current state, clearing the transitions signaled so far
+    virtual enum display_idle_state ReadState() = 0;
+    // Fd and poll events signaling a possible transition to idle, -1 if there is none
+    virtual int GetFd() const = 0;
+    virtual short GetEvents() const = 0;
+    // False if the display is never seen idle, boosts always run to their timeout then
+    virtual bool SignalsIdle() const { return true; }
+};
+
+// Create the source described by config, one of:
+//   sysfs:<path>                   idle_state node notified with sysfs_notify()
+//   vsync:<path>[:<idle_ms>]       node holding the CLOCK_MONOTONIC ns time of the last vsync,
+//                                  idle once no vsync came for idle_ms (100 by default)
+//   timer                          no idle signal
+// An empty config picks the first idle_state node of the known display drivers. Falls back to
+// timer when the config is invalid or its node cannot be opened.
+std::unique_ptr<DisplayIdleSource> CreateDisplayIdleSource(const std::string &config);
+
+// idle_state node of the display driver, notified with sysfs_notify()
+class SysfsIdleSource : public DisplayIdleSource {
+  public:
+    // Open the first of paths which exists, return nullptr if none does
+    static std::unique_ptr<SysfsIdleSource> Open(const std::vector<std::string> &paths);
+
+    enum display_idle_state ReadState() override;
+    int GetFd() const override { return mFd; }
+    short GetEvents() const override;
+
+  private:
+    explicit SysfsIdleSource(android::base::unique_fd fd) : mFd(std::move(fd)) {}
+
+    android::base::unique_fd mFd;
+};
+
+// Vsync timestamp node, with a timer firing when the display would go idle
+class VsyncIdleSource : public DisplayIdleSource {
+  public:
+    static std::unique_ptr<VsyncIdleSource> Open(const std::string &path, int32_t idle_ms);
+
+    enum display_idle_state ReadState() override;
+    int GetFd() const override { return mTimerFd; }
+    short GetEvents() const override;
+
+  private:
+    VsyncIdleSource(android::base::unique_fd fd, android::base::unique_fd timer_fd,
+                    int32_t idle_ms)
+        : mFd(std::move(fd)), mTimerFd(std::move(timer_fd)), mIdleMs(idle_ms) {}
+
+    android::base::unique_fd mFd;
+    android::base::unique_fd mTimerFd;
+    int32_t mIdleMs;
+};
+
+class TimerIdleSource : public DisplayIdleSource {
+  public:
+    enum display_idle_state ReadState() override { return DISPLAY_IDLE_STATE_BUSY; }
+    int GetFd() const override { return -1; }
+    short GetEvents() const override { return 0; }
+    bool SignalsIdle() const override { return false; }
+};
+
+#endif  // POWER_LIBPERFMGR_DISPLAYIDLESOURCE_H_
@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef POWER_LIBPERFMGR_HINTSINK_H_
+#define POWER_LIBPERFMGR_HINTSINK_H_
+
+#include <chrono>
+#include <string>
+
+// Receiver of the hints, libperfmgr on device and a fake in host tools.
+class HintSink {
+  public:
+    virtual ~HintSink() {}
+    virtual bool DoHint(const std::string &hint) = 0;
+    virtual bool DoHint(const std::string &hint, std::chrono::milliseconds timeout) = 0;
+    virtual bool EndHint(const std::string &hint) = 0;
+    virtual bool IsRunning() const = 0;
+    virtual bool IsHintSupported(const std::string &hint) const = 0;
+    virtual void DumpToFd(int fd) = 0;
+};
+
+#endif  // POWER_LIBPERFMGR_HINTSINK_H_
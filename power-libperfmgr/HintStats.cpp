@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cinttypes>
+#include <limits>
+
+#include <android-base/stringprintf.h>
+
+#include "HintStats.h"
+
+using android::base::StringAppendF;
+
+static int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+}
+
+void LatencyHistogram::Record(std::chrono::nanoseconds latency) {
+    const uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+    size_t bucket = 0;
+    while (bucket < kNumBuckets - 1 && us >= (1ull << bucket)) {
+        ++bucket;
+    }
+    mBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    mCount.fetch_add(1, std::memory_order_relaxed);
+    uint64_t max_us = mMaxUs.load(std::memory_order_relaxed);
+    while (us > max_us && !mMaxUs.compare_exchange_weak(max_us, us, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::Dump(std::string *out) const {
+    StringAppendF(out, "Count: %" PRIu64 " Max: %" PRIu64 "us",
+                  mCount.load(std::memory_order_relaxed), mMaxUs.load(std::memory_order_relaxed));
+    for (size_t bucket = 0; bucket < kNumBuckets; ++bucket) {
+        const uint64_t count = mBuckets[bucket].load(std::memory_order_relaxed);
+        if (count == 0) {
+            continue;
+        }
+        if (bucket == kNumBuckets - 1) {
+            StringAppendF(out, " >=%lluus: %" PRIu64, 1ull << (bucket - 1), count);
+        } else {
+            StringAppendF(out, " <%lluus: %" PRIu64, 1ull << bucket, count);
+        }
+    }
+}
+
+HintStats::HintStats(std::shared_ptr<HintSink> const &hint_sink,
+                     const std::vector<std::string> &hints)
+    : mHintSink(hint_sink) {
+    for (const auto &hint : hints) {
+        mHintUsage.emplace(hint, std::make_unique<HintUsage>());
+    }
+}
+
+bool HintStats::DoHint(const std::string &hint) {
+    const int64_t start_ns = NowNs();
+    const bool ret = mHintSink->DoHint(hint);
+    return RecordDoHint(hint, std::numeric_limits<int64_t>::max(), ret, start_ns);
+}
+
+bool HintStats::DoHint(const std::string &hint, std::chrono::milliseconds timeout) {
+    const int64_t start_ns = NowNs();
+    const bool ret = mHintSink->DoHint(hint, timeout);
+    return RecordDoHint(
+            hint, start_ns + std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count(),
+            ret, start_ns);
+}
+
+bool HintStats::RecordDoHint(const std::string &hint, int64_t until_ns, bool ret,
+                             int64_t start_ns) {
+    const int64_t now_ns = NowNs();
+    mDoHintLatency.Record(std::chrono::nanoseconds(now_ns - start_ns));
+    const auto it = mHintUsage.find(hint);
+    if (!ret || it == mHintUsage.end()) {
+        return ret;
+    }
+    HintUsage &usage = *it->second;
+    usage.do_count.fetch_add(1, std::memory_order_relaxed);
+    usage.last_do_ns.store(start_ns, std::memory_order_relaxed);
+    const int64_t since_ns = usage.active_since_ns.load(std::memory_order_relaxed);
+    const int64_t prev_until_ns = usage.active_until_ns.load(std::memory_order_relaxed);
+    if (since_ns == 0 || start_ns >= prev_until_ns) {
+        // Account an activation which timed out before starting a new one
+        if (since_ns != 0) {
+            usage.active_ns.fetch_add(prev_until_ns - since_ns, std::memory_order_relaxed);
+        }
+        usage.active_since_ns.store(start_ns, std::memory_order_relaxed);
+    }
+    // A new DoHint() replaces the timeout of the previous one
+    usage.active_until_ns.store(until_ns, std::memory_order_relaxed);
+    return ret;
+}
+
+bool HintStats::EndHint(const std::string &hint) {
+    const int64_t start_ns = NowNs();
+    const bool ret = mHintSink->EndHint(hint);
+    const int64_t now_ns = NowNs();
+    mEndHintLatency.Record(std::chrono::nanoseconds(now_ns - start_ns));
+    const auto it = mHintUsage.find(hint);
+    if (it == mHintUsage.end()) {
+        return ret;
+    }
+    HintUsage &usage = *it->second;
+    usage.end_count.fetch_add(1, std::memory_order_relaxed);
+    const int64_t since_ns = usage.active_since_ns.load(std::memory_order_relaxed);
+    if (since_ns != 0) {
+        const int64_t until_ns = usage.active_until_ns.load(std::memory_order_relaxed);
+        usage.active_ns.fetch_add(std::min(start_ns, until_ns) - since_ns,
+                                  std::memory_order_relaxed);
+        usage.active_since_ns.store(0, std::memory_order_relaxed);
+    }
+    return ret;
+}
+
+void HintStats::Dump(std::string *out) const {
+    const int64_t now_ns = NowNs();
+    out->append("Hints:\n");
+    for (const auto &hint_usage_pair : mHintUsage) {
+        const HintUsage &usage = *hint_usage_pair.second;
+        const uint64_t do_count = usage.do_count.load(std::memory_order_relaxed);
+        if (do_count == 0) {
+            continue;
+        }
+        int64_t active_ns = usage.active_ns.load(std::memory_order_relaxed);
+        const int64_t since_ns = usage.active_since_ns.load(std::memory_order_relaxed);
+        const int64_t until_ns = usage.active_until_ns.load(std::memory_order_relaxed);
+        const bool active = since_ns != 0 && now_ns < until_ns;
+        if (since_ns != 0) {
+            active_ns += std::min(now_ns, until_ns) - since_ns;
+        }
+        StringAppendF(out,
+                      " %s DoHint: %" PRIu64 " EndHint: %" PRIu64 " LastDoHint: %" PRId64
+                      "ms ago ActiveTime: %" PRId64 "ms%s\n",
+                      hint_usage_pair.first.c_str(), do_count,
+                      usage.end_count.load(std::memory_order_relaxed),
+                      (now_ns - usage.last_do_ns.load(std::memory_order_relaxed)) / 1000000,
+                      active_ns / 1000000, active ? " (active)" : "");
+    }
+    out->append("DoHint latency: ");
+    mDoHintLatency.Dump(out);
+    out->append("\nEndHint latency: ");
+    mEndHintLatency.Dump(out);
+    out->append("\n");
+}
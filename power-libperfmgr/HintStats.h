@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef POWER_LIBPERFMGR_HINTSTATS_H_
+#define POWER_LIBPERFMGR_HINTSTATS_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "HintSink.h"
+
+// Latency histogram with power of two buckets from 1us, updated with relaxed atomics.
+class LatencyHistogram {
+  public:
+    // [0, 1us), [1us, 2us), ... [16.384ms, inf)
+    static constexpr size_t kNumBuckets = 16;
+
+    void Record(std::chrono::nanoseconds latency);
+    // Append the count, the max and the non empty buckets
+    void Dump(std::string *out) const;
+
+  private:
+    std::array<std::atomic<uint64_t>, kNumBuckets> mBuckets{};
+    std::atomic<uint64_t> mCount{0};
+    std::atomic<uint64_t> mMaxUs{0};
+};
+
+// Forwards hints to a HintSink, keeping the usage of each hint and the latency of the calls.
+// Statistics are kept for the hints given at construction. The calls for a hint must not run
+// concurrently, the dump may.
+class HintStats {
+  public:
+    HintStats(std::shared_ptr<HintSink> const &hint_sink, const std::vector<std::string> &hints);
+
+    bool DoHint(const std::string &hint);
+    bool DoHint(const std::string &hint, std::chrono::milliseconds timeout);
+    bool EndHint(const std::string &hint);
+    bool IsRunning() const { return mHintSink->IsRunning(); }
+    bool IsHintSupported(const std::string &hint) const {
+        return mHintSink->IsHintSupported(hint);
+    }
+    void DumpToFd(int fd) { mHintSink->DumpToFd(fd); }
+    // Append the usage of each hint and the DoHint/EndHint latency histograms
+    void Dump(std::string *out) const;
+
+  private:
+    // Steady clock times in ns, a hint is active from active_since to active_until while
+    // active_since is not 0.
+    struct HintUsage {
+        std::atomic<uint64_t> do_count{0};
+        std::atomic<uint64_t> end_count{0};
+        std::atomic<int64_t> last_do_ns{0};
+        std::atomic<int64_t> active_since_ns{0};
+        std::atomic<int64_t> active_until_ns{0};
+        // Duration of the finished activations
+        std::atomic<int64_t> active_ns{0};
+    };
+
+    bool RecordDoHint(const std::string &hint, int64_t until_ns, bool ret, int64_t start_ns);
+
+    std::shared_ptr<HintSink> mHintSink;
+    // Keys are fixed after construction
+    std::map<std::string, std::unique_ptr<HintUsage>> mHintUsage;
+    LatencyHistogram mDoHintLatency;
+    LatencyHistogram mEndHintLatency;
+};
+
+#endif  // POWER_LIBPERFMGR_HINTSTATS_H_
@@ -17,63 +17,62 @@
 #define LOG_TAG "android.hardware.power@1.3-service.pixel-libperfmgr"
 #define ATRACE_TAG (ATRACE_TAG_POWER | ATRACE_TAG_HAL)
 
-#include <fcntl.h>
 #include <poll.h>
 #include <sys/eventfd.h>
 #include <time.h>
 #include <unistd.h>
 #include <utils/Log.h>
 #include <utils/Trace.h>
+#include <algorithm>
+#include <cmath>
 #include <memory>
 
 #include "InteractionHandler.h"
 
-#define MAX_LENGTH 64
-
 #define MSINSEC 1000L
 #define USINMS 1000000L
+#define NSINSEC 1000000000L
+
+// Busy time samples needed before predicting durations, and EWMA gains of the mean and the
+// deviation (RFC 6298 values).
+static constexpr uint32_t kMinBusySamples = 4;
+static constexpr float kBusyMeanGain = 1.0f / 8;
+static constexpr float kBusyDevGain = 1.0f / 4;
 
-static const std::vector<std::string> fb_idle_patch = {"/sys/class/drm/card0/device/idle_state",
-                                                       "/sys/class/graphics/fb0/idle_state"};
+static const std::string kInteractionHint = "INTERACTION";
 
-InteractionHandler::InteractionHandler(std::shared_ptr<HintManager> const &hint_manager)
+InteractionHandler::InteractionHandler(std::shared_ptr<HintStats> const &hint_stats,
+                                       std::unique_ptr<DisplayIdleSource> idle_source)
     : mState(INTERACTION_STATE_UNINITIALIZED),
       mWaitMs(100),
       mMinDurationMs(1400),
       mMaxDurationMs(5650),
       mDurationMs(0),
-      mHintManager(hint_manager) {}
+      mAdaptiveMinDurationMs(500),
+      mBusyMeanMs(0),
+      mBusyDevMs(0),
+      mBusySamples(0),
+      mPredictedDurationMs(-1),
+      mBoostDeadlineNs(0),
+      mHintStats(hint_stats),
+      mIdleSource(std::move(idle_source)) {}
 
 InteractionHandler::~InteractionHandler() {
     Exit();
 }
 
-static int fb_idle_open(void) {
-    int fd;
-    for (auto &path : fb_idle_patch) {
-        fd = open(path.c_str(), O_RDONLY);
-        if (fd >= 0)
-            return fd;
-    }
-    ALOGE("Unable to open fb idle state path (%d)", errno);
-    return -1;
-}
-
 bool InteractionHandler::Init() {
     std::lock_guard<std::mutex> lk(mLock);
 
     if (mState != INTERACTION_STATE_UNINITIALIZED)
         return true;
 
-    int fd = fb_idle_open();
-    if (fd < 0)
-        return false;
-    mIdleFd = fd;
+    if (!mIdleSource)
+        mIdleSource = CreateDisplayIdleSource("");
 
     mEventFd = eventfd(0, EFD_NONBLOCK);
     if (mEventFd < 0) {
         ALOGE("Unable to create event fd (%d)", errno);
-        close(mIdleFd);
         return false;
     }
 
@@ -90,18 +89,18 @@ void InteractionHandler::Exit() {
 
     AbortWaitLocked();
     mState = INTERACTION_STATE_UNINITIALIZED;
+    mBoostDeadlineNs.store(0, std::memory_order_release);
     lk.unlock();
 
     mCond.notify_all();
     mThread->join();
 
     close(mEventFd);
-    close(mIdleFd);
 }
 
 void InteractionHandler::PerfLock() {
     ALOGV("%s: acquiring perf lock", __func__);
-    if (!mHintManager->DoHint("INTERACTION")) {
+    if (!mHintStats->DoHint(kInteractionHint)) {
         ALOGE("%s: do hint INTERACTION failed", __func__);
     }
     ATRACE_INT("interaction_lock", 1);
@@ -109,7 +108,7 @@ void InteractionHandler::PerfLock() {
 
 void InteractionHandler::PerfRel() {
     ALOGV("%s: releasing perf lock", __func__);
-    if (!mHintManager->EndHint("INTERACTION")) {
+    if (!mHintStats->EndHint(kInteractionHint)) {
         ALOGE("%s: end hint INTERACTION failed", __func__);
     }
     ATRACE_INT("interaction_lock", 0);
@@ -123,6 +122,19 @@ size_t InteractionHandler::CalcTimespecDiffMs(struct timespec start, struct time
 }
 
 void InteractionHandler::Acquire(int32_t duration) {
+    const int32_t finalDuration = CalcDuration(duration);
+
+    // clock_gettime() is served from the vDSO, the fast path makes no syscall
+    struct timespec cur_timespec;
+    clock_gettime(CLOCK_MONOTONIC, &cur_timespec);
+    const int64_t finalDeadlineNs = static_cast<int64_t>(cur_timespec.tv_sec) * NSINSEC +
+                                    cur_timespec.tv_nsec +
+                                    static_cast<int64_t>(finalDuration) * USINMS;
+    // don't hint if previous hint's duration covers this hint's duration
+    if (finalDeadlineNs <= mBoostDeadlineNs.load(std::memory_order_acquire)) {
+        return;
+    }
+
     ATRACE_CALL();
 
     std::lock_guard<std::mutex> lk(mLock);
@@ -131,29 +143,15 @@ void InteractionHandler::Acquire(int32_t duration) {
         return;
     }
 
-    int inputDuration = duration + 650;
-    int finalDuration;
-    if (inputDuration > mMaxDurationMs)
-        finalDuration = mMaxDurationMs;
-    else if (inputDuration > mMinDurationMs)
-        finalDuration = inputDuration;
-    else
-        finalDuration = mMinDurationMs;
-
-    struct timespec cur_timespec;
-    clock_gettime(CLOCK_MONOTONIC, &cur_timespec);
-    if (mState != INTERACTION_STATE_IDLE && finalDuration <= mDurationMs) {
-        size_t elapsed_time = CalcTimespecDiffMs(mLastTimespec, cur_timespec);
-        // don't hint if previous hint's duration covers this hint's duration
-        if (elapsed_time <= (mDurationMs - finalDuration)) {
-            ALOGV("%s: Previous duration (%d) cover this (%d) elapsed: %lld", __func__,
-                  static_cast<int>(mDurationMs), static_cast<int>(finalDuration),
-                  static_cast<long long>(elapsed_time));
-            return;
-        }
+    // Another interaction may have extended the boost since the check above
+    if (finalDeadlineNs <= mBoostDeadlineNs.load(std::memory_order_relaxed)) {
+        ALOGV("%s: Previous duration (%d) cover this (%d)", __func__,
+              static_cast<int>(mDurationMs), static_cast<int>(finalDuration));
+        return;
     }
     mLastTimespec = cur_timespec;
     mDurationMs = finalDuration;
+    mBoostDeadlineNs.store(finalDeadlineNs, std::memory_order_release);
 
     ALOGV("%s: input: %d final duration: %d", __func__, duration, finalDuration);
 
@@ -166,10 +164,48 @@ void InteractionHandler::Acquire(int32_t duration) {
     mCond.notify_one();
 }
 
-void InteractionHandler::Release() {
+int32_t InteractionHandler::CalcDuration(int32_t duration) const {
+    const int32_t predicted = mPredictedDurationMs.load(std::memory_order_relaxed);
+    if (predicted < 0) {
+        return std::clamp(duration + 650, mMinDurationMs, mMaxDurationMs);
+    }
+    // Cover most of the busy times seen so far, a longer hinted duration still wins
+    return std::clamp(std::max(predicted, duration), mAdaptiveMinDurationMs, mMaxDurationMs);
+}
+
+// should be called while locked
+void InteractionHandler::UpdateBusyModelLocked(size_t busy_ms) {
+    const float sample = static_cast<float>(busy_ms);
+    if (mBusySamples == 0) {
+        mBusyMeanMs = sample;
+        mBusyDevMs = sample / 2;
+    } else {
+        mBusyDevMs += kBusyDevGain * (std::abs(sample - mBusyMeanMs) - mBusyDevMs);
+        mBusyMeanMs += kBusyMeanGain * (sample - mBusyMeanMs);
+    }
+    ++mBusySamples;
+    if (mBusySamples >= kMinBusySamples) {
+        mPredictedDurationMs.store(static_cast<int32_t>(mBusyMeanMs + 4 * mBusyDevMs),
+                                   std::memory_order_relaxed);
+    }
+    ATRACE_INT("interaction_busy_ms", static_cast<int32_t>(busy_ms));
+    ALOGV("%s: busy: %zu mean: %f dev: %f", __func__, busy_ms, mBusyMeanMs, mBusyDevMs);
+}
+
+void InteractionHandler::Release(enum wait_result result) {
     std::lock_guard<std::mutex> lk(mLock);
     if (mState == INTERACTION_STATE_WAITING) {
         ATRACE_CALL();
+        // A timeout only bounds the busy time from below, count it as is so that durations
+        // too short for the interactions grow back. Without idle signal every release is a
+        // timeout, which says nothing about the busy time.
+        if ((result == WAIT_RESULT_IDLE || result == WAIT_RESULT_TIMEOUT) &&
+            mIdleSource->SignalsIdle()) {
+            struct timespec cur_timespec;
+            clock_gettime(CLOCK_MONOTONIC, &cur_timespec);
+            UpdateBusyModelLocked(CalcTimespecDiffMs(mLastTimespec, cur_timespec));
+        }
+        mBoostDeadlineNs.store(0, std::memory_order_release);
         PerfRel();
         mState = INTERACTION_STATE_IDLE;
     } else {
@@ -189,8 +225,7 @@ void InteractionHandler::AbortWaitLocked() {
         ALOGW("Unable to write to event fd (%zd)", ret);
 }
 
-void InteractionHandler::WaitForIdle(int32_t wait_ms, int32_t timeout_ms) {
-    char data[MAX_LENGTH];
+enum wait_result InteractionHandler::WaitForIdle(int32_t wait_ms, int32_t timeout_ms) {
     ssize_t ret;
     struct pollfd pfd[2];
 
@@ -200,38 +235,61 @@ void InteractionHandler::WaitForIdle(int32_t wait_ms, int32_t timeout_ms) {
 
     pfd[0].fd = mEventFd;
     pfd[0].events = POLLIN;
-    pfd[1].fd = mIdleFd;
-    pfd[1].events = POLLPRI | POLLERR;
+    pfd[1].fd = mIdleSource->GetFd();
+    pfd[1].events = mIdleSource->GetEvents();
 
     ret = poll(pfd, 1, wait_ms);
     if (ret > 0) {
         ALOGV("%s: wait aborted", __func__);
-        return;
+        return WAIT_RESULT_ABORTED;
     } else if (ret < 0) {
         ALOGE("%s: error in poll while waiting", __func__);
-        return;
+        return WAIT_RESULT_ERROR;
     }
 
-    ret = pread(mIdleFd, data, sizeof(data), 0);
-    if (!ret) {
-        ALOGE("%s: Unexpected EOF!", __func__);
-        return;
+    const enum display_idle_state state = mIdleSource->ReadState();
+    if (state == DISPLAY_IDLE_STATE_ERROR) {
+        return WAIT_RESULT_ERROR;
     }
 
-    if (!strncmp(data, "idle", 4)) {
+    if (state == DISPLAY_IDLE_STATE_IDLE) {
         ALOGV("%s: already idle", __func__);
-        return;
+        return WAIT_RESULT_IDLE;
     }
 
-    ret = poll(pfd, 2, timeout_ms);
-    if (ret < 0)
-        ALOGE("%s: Error on waiting for idle (%zd)", __func__, ret);
-    else if (ret == 0)
-        ALOGV("%s: timed out waiting for idle", __func__);
-    else if (pfd[0].revents)
-        ALOGV("%s: wait for idle aborted", __func__);
-    else if (pfd[1].revents)
-        ALOGV("%s: idle detected", __func__);
+    struct timespec start_timespec;
+    clock_gettime(CLOCK_MONOTONIC, &start_timespec);
+    int32_t remaining_ms = timeout_ms;
+    while (true) {
+        ret = poll(pfd, 2, remaining_ms);
+        if (ret < 0) {
+            ALOGE("%s: Error on waiting for idle (%zd)", __func__, ret);
+            return WAIT_RESULT_ERROR;
+        } else if (ret == 0) {
+            ALOGV("%s: timed out waiting for idle", __func__);
+            return WAIT_RESULT_TIMEOUT;
+        } else if (pfd[0].revents) {
+            ALOGV("%s: wait for idle aborted", __func__);
+            return WAIT_RESULT_ABORTED;
+        }
+
+        // Sources may signal before the display is actually idle, check the state
+        const enum display_idle_state state = mIdleSource->ReadState();
+        if (state == DISPLAY_IDLE_STATE_ERROR) {
+            return WAIT_RESULT_ERROR;
+        } else if (state == DISPLAY_IDLE_STATE_IDLE) {
+            ALOGV("%s: idle detected", __func__);
+            return WAIT_RESULT_IDLE;
+        }
+
+        struct timespec cur_timespec;
+        clock_gettime(CLOCK_MONOTONIC, &cur_timespec);
+        remaining_ms = timeout_ms - CalcTimespecDiffMs(start_timespec, cur_timespec);
+        if (remaining_ms <= 0) {
+            ALOGV("%s: timed out waiting for idle", __func__);
+            return WAIT_RESULT_TIMEOUT;
+        }
+    }
 }
 
 void InteractionHandler::Routine() {
@@ -245,7 +303,6 @@ void InteractionHandler::Routine() {
         mState = INTERACTION_STATE_WAITING;
         lk.unlock();
 
-        WaitForIdle(mWaitMs, mDurationMs);
-        Release();
+        Release(WaitForIdle(mWaitMs, mDurationMs));
     }
 }
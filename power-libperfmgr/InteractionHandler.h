@@ -17,15 +17,15 @@
 #ifndef POWER_LIBPERFMGR_INTERACTIONHANDLER_H_
 #define POWER_LIBPERFMGR_INTERACTIONHANDLER_H_
 
+#include <atomic>
 #include <condition_variable>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
 
-#include <perfmgr/HintManager.h>
-
-using ::android::perfmgr::HintManager;
+#include "DisplayIdleSource.h"
+#include "HintStats.h"
 
 enum interaction_state {
     INTERACTION_STATE_UNINITIALIZED,
@@ -34,17 +34,28 @@ enum interaction_state {
     INTERACTION_STATE_WAITING,
 };
 
+enum wait_result {
+    WAIT_RESULT_ABORTED,
+    WAIT_RESULT_IDLE,
+    WAIT_RESULT_TIMEOUT,
+    WAIT_RESULT_ERROR,
+};
+
 class InteractionHandler {
   public:
-    InteractionHandler(std::shared_ptr<HintManager> const &hint_manager);
+    // Without idle_source, Init() uses the default of CreateDisplayIdleSource()
+    InteractionHandler(std::shared_ptr<HintStats> const &hint_stats,
+                       std::unique_ptr<DisplayIdleSource> idle_source = nullptr);
     ~InteractionHandler();
     bool Init();
     void Exit();
     void Acquire(int32_t duration);
 
   private:
-    void Release();
-    void WaitForIdle(int32_t wait_ms, int32_t timeout_ms);
+    void Release(enum wait_result result);
+    enum wait_result WaitForIdle(int32_t wait_ms, int32_t timeout_ms);
+    int32_t CalcDuration(int32_t duration) const;
+    void UpdateBusyModelLocked(size_t busy_ms);
     void AbortWaitLocked();
     void Routine();
 
@@ -55,20 +66,33 @@ class InteractionHandler {
 
     enum interaction_state mState;
 
-    int mIdleFd;
     int mEventFd;
 
     int32_t mWaitMs;
     int32_t mMinDurationMs;
     int32_t mMaxDurationMs;
     int32_t mDurationMs;
+    // Lower bound of the duration once it is predicted from the busy model
+    int32_t mAdaptiveMinDurationMs;
+
+    // How long the display stays busy after an interaction, smoothed mean and mean deviation
+    // in ms like a TCP RTT estimate. Boost durations follow it once it has enough samples.
+    float mBusyMeanMs;
+    float mBusyDevMs;
+    uint32_t mBusySamples;
+    // mBusyMeanMs + 4 * mBusyDevMs, or -1 until the model has enough samples
+    std::atomic<int32_t> mPredictedDurationMs;
+    // CLOCK_MONOTONIC end of the current boost in ns, 0 while idle. Written under mLock and read
+    // without it, so interactions covered by the current boost return without locking.
+    std::atomic<int64_t> mBoostDeadlineNs;
 
     struct timespec mLastTimespec;
 
     std::unique_ptr<std::thread> mThread;
     std::mutex mLock;
     std::condition_variable mCond;
-    std::shared_ptr<HintManager> mHintManager;
+    std::shared_ptr<HintStats> mHintStats;
+    std::unique_ptr<DisplayIdleSource> mIdleSource;
 };
 
 #endif  // POWER_LIBPERFMGR_INTERACTIONHANDLER_H_
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef POWER_LIBPERFMGR_PERFMGRHINTSINK_H_
+#define POWER_LIBPERFMGR_PERFMGRHINTSINK_H_
+
+#include <memory>
+#include <string>
+
+#include <perfmgr/HintManager.h>
+
+#include "HintSink.h"
+
+// Hints applied by libperfmgr
+class PerfmgrHintSink : public HintSink {
+  public:
+    explicit PerfmgrHintSink(std::shared_ptr<::android::perfmgr::HintManager> const &hint_manager)
+        : mHintManager(hint_manager) {}
+
+    bool DoHint(const std::string &hint) override { return mHintManager->DoHint(hint); }
+    bool DoHint(const std::string &hint, std::chrono::milliseconds timeout) override {
+        return mHintManager->DoHint(hint, timeout);
+    }
+    bool EndHint(const std::string &hint) override { return mHintManager->EndHint(hint); }
+    bool IsRunning() const override { return mHintManager->IsRunning(); }
+    bool IsHintSupported(const std::string &hint) const override {
+        return mHintManager->IsHintSupported(hint);
+    }
+    void DumpToFd(int fd) override { mHintManager->DumpToFd(fd); }
+
+  private:
+    std::shared_ptr<::android::perfmgr::HintManager> mHintManager;
+};
+
+#endif  // POWER_LIBPERFMGR_PERFMGRHINTSINK_H_
@@ -23,12 +23,17 @@
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
 #include <mutex>
+#include <vector>
 
 #include <utils/Log.h>
 #include <utils/Trace.h>
 
 #include "AudioStreaming.h"
+#include "PerfmgrHintSink.h"
 #include "Power.h"
 #include "display-helper.h"
 
@@ -48,65 +53,129 @@ constexpr char kPowerHalStateProp[] = "vendor.powerhal.state";
 constexpr char kPowerHalAudioProp[] = "vendor.powerhal.audio";
 constexpr char kPowerHalInitProp[] = "vendor.powerhal.init";
 constexpr char kPowerHalRenderingProp[] = "vendor.powerhal.rendering";
+constexpr char kPowerHalIdleSourceProp[] = "ro.vendor.powerhal.idle_source";
 constexpr char kPowerHalConfigPath[] = "/vendor/etc/powerhint.json";
 
-static const std::map<enum CameraStreamingMode, std::string> kCamStreamingHint = {
-        {CAMERA_STREAMING_OFF, "CAMERA_STREAMING_OFF"},
-        {CAMERA_STREAMING, "CAMERA_STREAMING"},
-        {CAMERA_STREAMING_1080P, "CAMERA_STREAMING_1080P"},
-        {CAMERA_STREAMING_60FPS, "CAMERA_STREAMING_60FPS"},
-        {CAMERA_STREAMING_4K, "CAMERA_STREAMING_4K"},
-        {CAMERA_STREAMING_SECURE, "CAMERA_STREAMING_SECURE"}};
+// libperfmgr hint of each camera streaming mode, indexed by mode
+static const std::array<std::string, CAMERA_STREAMING_MAX> kCamStreamingHint = {
+        "CAMERA_STREAMING_OFF",   "CAMERA_STREAMING",    "CAMERA_STREAMING_1080P",
+        "CAMERA_STREAMING_60FPS", "CAMERA_STREAMING_4K", "CAMERA_STREAMING_SECURE"};
+static const std::string kCameraLaunchHint = "CAMERA_LAUNCH";
+static const std::string kTpuBoostHint = "TPU_BOOST";
+
+const std::array<std::array<std::string, 2>, 2> Power::kPerfModeHint = {{
+        // sustained performance mode off: VR mode off, on
+        {"", "VR_MODE"},
+        // sustained performance mode on: VR mode off, on
+        {"SUSTAINED_PERFORMANCE", "VR_SUSTAINED_PERFORMANCE"},
+}};
+
+const std::array<Power::HintDispatch, Power::kNumHints> Power::kHintDispatch = [] {
+    std::array<HintDispatch, kNumHints> table{};
+    const auto set = [&table](PowerHint_1_3 hint, HintDispatch entry) {
+        table[static_cast<size_t>(hint)] = std::move(entry);
+    };
+    // Hints without handler are only traced. InteractionHandler is thread safe, so touch boosts
+    // run inline; the hints setting a state are coalesced; AUDIO_STREAMING data are commands,
+    // serialized among themselves only.
+    constexpr auto kInline = HintExecution::INLINE;
+    constexpr auto kCoalesced = HintExecution::COALESCED;
+    constexpr auto kSerialized = HintExecution::SERIALIZED;
+    set(PowerHint_1_3::VSYNC, {"VSYNC", false, kInline, nullptr});
+    set(PowerHint_1_3::INTERACTION,
+        {"INTERACTION", true, kInline, &Power::handleInteraction});
+    set(PowerHint_1_3::VIDEO_ENCODE, {"VIDEO_ENCODE", false, kInline, nullptr});
+    set(PowerHint_1_3::VIDEO_DECODE, {"VIDEO_DECODE", false, kInline, nullptr});
+    set(PowerHint_1_3::LOW_POWER, {"LOW_POWER", false, kCoalesced, &Power::handleLowPower});
+    set(PowerHint_1_3::SUSTAINED_PERFORMANCE,
+        {"SUSTAINED_PERFORMANCE", false, kCoalesced, &Power::handleSustainedPerformance});
+    set(PowerHint_1_3::VR_MODE, {"VR_MODE", false, kCoalesced, &Power::handleVrMode});
+    set(PowerHint_1_3::LAUNCH, {"LAUNCH", true, kCoalesced, &Power::handleBoost});
+    set(PowerHint_1_3::AUDIO_STREAMING,
+        {"AUDIO_STREAMING", true, kSerialized, &Power::handleAudioStreaming});
+    set(PowerHint_1_3::AUDIO_LOW_LATENCY,
+        {"AUDIO_LOW_LATENCY", false, kCoalesced, &Power::handleBoost});
+    set(PowerHint_1_3::CAMERA_LAUNCH,
+        {"CAMERA_LAUNCH", false, kCoalesced, &Power::handleCameraLaunch});
+    set(PowerHint_1_3::CAMERA_STREAMING,
+        {"CAMERA_STREAMING", false, kCoalesced, &Power::handleCameraStreaming});
+    set(PowerHint_1_3::CAMERA_SHOT,
+        {"CAMERA_SHOT", false, kCoalesced, &Power::handleCameraShot});
+    set(PowerHint_1_3::EXPENSIVE_RENDERING,
+        {"EXPENSIVE_RENDERING", true, kCoalesced, &Power::handleExpensiveRendering});
+    return table;
+}();
 
 Power::Power()
-    : mHintManager(nullptr),
+    : mHintStats(nullptr),
       mInteractionHandler(nullptr),
+      mRenderingBoost(nullptr),
       mVRModeOn(false),
       mSustainedPerfModeOn(false),
       mCameraStreamingMode(CAMERA_STREAMING_OFF),
-      mReady(false) {
+      mReady(false),
+      mPendingHints(0) {
+    static_assert(kNumHints <= 32, "mPendingHints has a bit per hint");
+    for (auto &data : mPendingHintData) {
+        data.store(0, std::memory_order_relaxed);
+    }
+    for (auto &count : mHintCount) {
+        count.store(0, std::memory_order_relaxed);
+    }
+    mHintThread = std::thread(&Power::hintLoop, this);
+    mHintThread.detach();
     mInitThread = std::thread([this]() {
-        android::base::WaitForProperty(kPowerHalInitProp, "1");
-        mHintManager = HintManager::GetFromJSON(kPowerHalConfigPath);
-        if (!mHintManager) {
+        // Parse the config while init sets the nodes up, libperfmgr only writes them once
+        // started.
+        std::shared_ptr<HintManager> hint_manager =
+                HintManager::GetFromJSON(kPowerHalConfigPath, false);
+        if (!hint_manager) {
             LOG(FATAL) << "Invalid config: " << kPowerHalConfigPath;
         }
-        mInteractionHandler = std::make_unique<InteractionHandler>(mHintManager);
+        // Keep the usage of every libperfmgr hint this HAL does
+        std::vector<std::string> hints(kCamStreamingHint.begin(), kCamStreamingHint.end());
+        hints.emplace_back(kTpuBoostHint);
+        for (size_t level = 1; level <= RenderingBoost::kMaxLevels; ++level) {
+            hints.emplace_back(RenderingBoost::LevelHint(level));
+        }
+        for (const auto &entry : kHintDispatch) {
+            hints.emplace_back(entry.name);
+        }
+        for (const auto &vr_mode_hints : kPerfModeHint) {
+            hints.insert(hints.end(), vr_mode_hints.begin(), vr_mode_hints.end());
+        }
+        mHintStats =
+                std::make_shared<HintStats>(std::make_shared<PerfmgrHintSink>(hint_manager), hints);
+
+        android::base::WaitForProperty(kPowerHalInitProp, "1");
+        if (!hint_manager->Start()) {
+            LOG(FATAL) << "Failed to start HintManager";
+        }
+        mInteractionHandler = std::make_unique<InteractionHandler>(
+                mHintStats,
+                CreateDisplayIdleSource(android::base::GetProperty(kPowerHalIdleSourceProp, "")));
         mInteractionHandler->Init();
+        mRenderingBoost = std::make_unique<RenderingBoost>(mHintStats);
+        if (!mRenderingBoost->Init()) {
+            mRenderingBoost.reset();
+        }
         std::string state = android::base::GetProperty(kPowerHalStateProp, "");
-        if (state == "CAMERA_STREAMING") {
-            ALOGI("Initialize with CAMERA_STREAMING on");
-            mHintManager->DoHint("CAMERA_STREAMING");
-            mCameraStreamingMode = CAMERA_STREAMING;
-        } else if (state == "CAMERA_STREAMING_1080P") {
-            ALOGI("Initialize CAMERA_STREAMING_1080P on");
-            mHintManager->DoHint("CAMERA_STREAMING_1080P");
-            mCameraStreamingMode = CAMERA_STREAMING_1080P;
-        } else if (state == "CAMERA_STREAMING_60FPS") {
-            ALOGI("Initialize CAMERA_STREAMING_60FPS on");
-            mHintManager->DoHint("CAMERA_STREAMING_60FPS");
-            mCameraStreamingMode = CAMERA_STREAMING_60FPS;
-        } else if (state == "CAMERA_STREAMING_4K") {
-            ALOGI("Initialize with CAMERA_STREAMING_4K on");
-            mHintManager->DoHint("CAMERA_STREAMING_4K");
-            mCameraStreamingMode = CAMERA_STREAMING_4K;
-        } else if (state == "CAMERA_STREAMING_SECURE") {
-            ALOGI("Initialize with CAMERA_STREAMING_SECURE on");
-            mHintManager->DoHint("CAMERA_STREAMING_SECURE");
-            mCameraStreamingMode = CAMERA_STREAMING_SECURE;
-        } else if (state == "SUSTAINED_PERFORMANCE") {
+        const auto cam_it =
+                std::find(kCamStreamingHint.begin() + 1, kCamStreamingHint.end(), state);
+        if (cam_it != kCamStreamingHint.end()) {
+            ALOGI("Initialize with %s on", state.c_str());
+            mHintStats->DoHint(*cam_it);
+            mCameraStreamingMode =
+                    static_cast<enum CameraStreamingMode>(cam_it - kCamStreamingHint.begin());
+        } else if (state == kPerfModeHint[1][0]) {
             ALOGI("Initialize with SUSTAINED_PERFORMANCE on");
-            mHintManager->DoHint("SUSTAINED_PERFORMANCE");
-            mSustainedPerfModeOn = true;
-        } else if (state == "VR_MODE") {
+            setPerfModes(true, false);
+        } else if (state == kPerfModeHint[0][1]) {
             ALOGI("Initialize with VR_MODE on");
-            mHintManager->DoHint("VR_MODE");
-            mVRModeOn = true;
-        } else if (state == "VR_SUSTAINED_PERFORMANCE") {
+            setPerfModes(false, true);
+        } else if (state == kPerfModeHint[1][1]) {
             ALOGI("Initialize with SUSTAINED_PERFORMANCE and VR_MODE on");
-            mHintManager->DoHint("VR_SUSTAINED_PERFORMANCE");
-            mSustainedPerfModeOn = true;
-            mVRModeOn = true;
+            setPerfModes(true, true);
         } else {
             ALOGI("Initialize PowerHAL");
         }
@@ -114,101 +183,225 @@ Power::Power()
         state = android::base::GetProperty(kPowerHalAudioProp, "");
         if (state == "AUDIO_LOW_LATENCY") {
             ALOGI("Initialize with AUDIO_LOW_LATENCY on");
-            mHintManager->DoHint("AUDIO_LOW_LATENCY");
+            mHintStats->DoHint("AUDIO_LOW_LATENCY");
         }
 
         state = android::base::GetProperty(kPowerHalRenderingProp, "");
         if (state == "EXPENSIVE_RENDERING") {
             ALOGI("Initialize with EXPENSIVE_RENDERING on");
-            mHintManager->DoHint("EXPENSIVE_RENDERING");
+            const auto &entry =
+                    kHintDispatch[static_cast<size_t>(PowerHint_1_3::EXPENSIVE_RENDERING)];
+            handleExpensiveRendering(entry, 1);
         }
-        // Now start to take powerhint
-        mReady.store(true);
+        // Now start to take powerhint, and replay the ones received so far
+        {
+            std::lock_guard<std::mutex> lock(mHintThreadLock);
+            mReady.store(true);
+        }
+        mHintThreadCond.notify_one();
         ALOGI("PowerHAL ready to process hints");
     });
     mInitThread.detach();
 }
 
-// Methods from ::android::hardware::power::V1_0::IPower follow.
-Return<void> Power::setInteractive(bool /* interactive */) {
-    return Void();
-}
-
-Return<void> Power::powerHint(PowerHint_1_0 hint, int32_t data) {
-    if (!mReady) {
-        return Void();
+void Power::dispatchHint(PowerHint_1_3 hint, int32_t data) {
+    const size_t index = static_cast<size_t>(hint);
+    if (index >= kNumHints || kHintDispatch[index].name.empty()) {
+        ALOGE("%s: unknown hint %d", __func__, static_cast<int>(hint));
+        return;
     }
-    ATRACE_INT(android::hardware::power::V1_0::toString(hint).c_str(), data);
-    ALOGD_IF(hint != PowerHint_1_0::INTERACTION, "%s: %d",
-             android::hardware::power::V1_0::toString(hint).c_str(), static_cast<int>(data));
-    switch (hint) {
-        case PowerHint_1_0::INTERACTION:
-            if (mVRModeOn || mSustainedPerfModeOn) {
-                ALOGV("%s: ignoring due to other active perf hints", __func__);
-            } else {
-                mInteractionHandler->Acquire(data);
-            }
-            break;
-        case PowerHint_1_0::SUSTAINED_PERFORMANCE:
-            if (data && !mSustainedPerfModeOn) {
-                if (!mVRModeOn) {  // Sustained mode only.
-                    mHintManager->DoHint("SUSTAINED_PERFORMANCE");
-                } else {  // Sustained + VR mode.
-                    mHintManager->EndHint("VR_MODE");
-                    mHintManager->DoHint("VR_SUSTAINED_PERFORMANCE");
-                }
-                mSustainedPerfModeOn = true;
-            } else if (!data && mSustainedPerfModeOn) {
-                mHintManager->EndHint("VR_SUSTAINED_PERFORMANCE");
-                mHintManager->EndHint("SUSTAINED_PERFORMANCE");
-                if (mVRModeOn) {  // Switch back to VR Mode.
-                    mHintManager->DoHint("VR_MODE");
-                }
-                mSustainedPerfModeOn = false;
-            }
+    const HintDispatch &entry = kHintDispatch[index];
+    mHintCount[index].fetch_add(1, std::memory_order_relaxed);
+    ATRACE_INT(entry.name.c_str(), data);
+    ALOGD_IF(hint != PowerHint_1_3::INTERACTION, "%s: %d", entry.name.c_str(),
+             static_cast<int>(data));
+    if (entry.handler == nullptr) {
+        return;
+    }
+    // Coalesced hints set a state, the latest one is queued until ready. The others are boosts
+    // or commands which would be stale by then.
+    if (!mReady && entry.execution != HintExecution::COALESCED) {
+        return;
+    }
+    switch (entry.execution) {
+        case HintExecution::INLINE:
+            runHint(entry, data);
             break;
-        case PowerHint_1_0::VR_MODE:
-            if (data && !mVRModeOn) {
-                if (!mSustainedPerfModeOn) {  // VR mode only.
-                    mHintManager->DoHint("VR_MODE");
-                } else {  // Sustained + VR mode.
-                    mHintManager->EndHint("SUSTAINED_PERFORMANCE");
-                    mHintManager->DoHint("VR_SUSTAINED_PERFORMANCE");
-                }
-                mVRModeOn = true;
-            } else if (!data && mVRModeOn) {
-                mHintManager->EndHint("VR_SUSTAINED_PERFORMANCE");
-                mHintManager->EndHint("VR_MODE");
-                if (mSustainedPerfModeOn) {  // Switch back to sustained Mode.
-                    mHintManager->DoHint("SUSTAINED_PERFORMANCE");
-                }
-                mVRModeOn = false;
+        case HintExecution::COALESCED: {
+            const uint32_t bit = 1u << index;
+            mPendingHintData[index].store(data, std::memory_order_relaxed);
+            if (mPendingHints.fetch_or(bit, std::memory_order_release) == 0) {
+                // Lock so the wake up cannot fall between the check and the wait of hintLoop
+                { std::lock_guard<std::mutex> lock(mHintThreadLock); }
+                mHintThreadCond.notify_one();
             }
             break;
-        case PowerHint_1_0::LAUNCH:
-            if (mVRModeOn || mSustainedPerfModeOn) {
-                ALOGV("%s: ignoring due to other active perf hints", __func__);
-            } else {
-                if (data) {
-                    // Hint until canceled
-                    mHintManager->DoHint("LAUNCH");
-                } else {
-                    mHintManager->EndHint("LAUNCH");
-                }
-            }
+        }
+        case HintExecution::SERIALIZED: {
+            std::lock_guard<std::mutex> lock(mSerializedHintLock);
+            runHint(entry, data);
             break;
-        case PowerHint_1_0::LOW_POWER:
-            if (data) {
-                // Device in battery saver mode, enable display low power mode
-                set_display_lpm(true);
-            } else {
-                // Device exiting battery saver mode, disable display low power mode
-                set_display_lpm(false);
+        }
+    }
+}
+
+void Power::runHint(const HintDispatch &entry, int32_t data) {
+    if (entry.ignored_in_perf_mode && (mVRModeOn || mSustainedPerfModeOn)) {
+        ALOGV("%s: ignoring due to other active perf hints", __func__);
+        return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    (this->*entry.handler)(entry, data);
+    mHintLatency[&entry - kHintDispatch.data()].Record(std::chrono::steady_clock::now() - start);
+}
+
+void Power::hintLoop() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mHintThreadLock);
+            mHintThreadCond.wait(lock, [this] {
+                return mReady && mPendingHints.load(std::memory_order_relaxed) != 0;
+            });
+        }
+        // A hint arriving between the exchange and the data load is seen with its latest data
+        // and handled again on the next round, which is harmless for state setting hints.
+        // Coalesced handlers only run on this thread once mReady, so they need no lock.
+        uint32_t pending = mPendingHints.exchange(0, std::memory_order_acquire);
+        for (size_t index = 0; pending != 0; ++index, pending >>= 1) {
+            if (pending & 1) {
+                runHint(kHintDispatch[index],
+                        mPendingHintData[index].load(std::memory_order_relaxed));
             }
-            break;
-        default:
-            break;
+        }
+    }
+}
+
+void Power::setPerfModes(bool sustained_perf_mode_on, bool vr_mode_on) {
+    const std::string &prev_hint = kPerfModeHint[mSustainedPerfModeOn][mVRModeOn];
+    const std::string &hint = kPerfModeHint[sustained_perf_mode_on][vr_mode_on];
+    if (&hint == &prev_hint) {
+        return;
+    }
+    if (!prev_hint.empty()) {
+        mHintStats->EndHint(prev_hint);
+    }
+    if (!hint.empty()) {
+        mHintStats->DoHint(hint);
+    }
+    mSustainedPerfModeOn = sustained_perf_mode_on;
+    mVRModeOn = vr_mode_on;
+}
+
+void Power::handleInteraction(const HintDispatch &, int32_t data) {
+    mInteractionHandler->Acquire(data);
+}
+
+void Power::handleSustainedPerformance(const HintDispatch &, int32_t data) {
+    setPerfModes(data != 0, mVRModeOn);
+}
+
+void Power::handleVrMode(const HintDispatch &, int32_t data) {
+    setPerfModes(mSustainedPerfModeOn, data != 0);
+}
+
+void Power::handleLowPower(const HintDispatch &, int32_t data) {
+    // Enable display low power mode while the device is in battery saver mode
+    set_display_lpm(data != 0);
+}
+
+void Power::handleBoost(const HintDispatch &entry, int32_t data) {
+    if (data) {
+        // Hint until canceled
+        mHintStats->DoHint(entry.name);
+    } else {
+        mHintStats->EndHint(entry.name);
+    }
+}
+
+void Power::handleExpensiveRendering(const HintDispatch &entry, int32_t data) {
+    if (mRenderingBoost) {
+        mRenderingBoost->SetActive(data != 0);
+    } else {
+        handleBoost(entry, data);
+    }
+}
+
+void Power::handleCameraLaunch(const HintDispatch &entry, int32_t data) {
+    if (data > 0) {
+        mHintStats->DoHint(entry.name);
+    } else if (data == 0) {
+        mHintStats->EndHint(entry.name);
+    } else {
+        ALOGE("CAMERA LAUNCH INVALID DATA: %d", data);
+    }
+}
+
+void Power::handleCameraShot(const HintDispatch &entry, int32_t data) {
+    if (data > 0) {
+        mHintStats->DoHint(entry.name, std::chrono::milliseconds(data));
+    } else if (data == 0) {
+        mHintStats->EndHint(entry.name);
+    } else {
+        ALOGE("CAMERA SHOT INVALID DATA: %d", data);
+    }
+}
+
+void Power::handleCameraStreaming(const HintDispatch &, int32_t data) {
+    const enum CameraStreamingMode mode = static_cast<enum CameraStreamingMode>(data);
+    if (mode < CAMERA_STREAMING_OFF || mode >= CAMERA_STREAMING_MAX) {
+        ALOGE("CAMERA STREAMING INVALID Mode: %d", mode);
+        return;
+    }
+
+    if (mCameraStreamingMode == mode)
+        return;
+
+    // turn it off first if any previous hint.
+    if ((mCameraStreamingMode != CAMERA_STREAMING_OFF)) {
+        mHintStats->EndHint(kCamStreamingHint[mCameraStreamingMode]);
+        if ((mCameraStreamingMode != CAMERA_STREAMING_SECURE)) {
+            // Boost 1s for tear down if not secure streaming use case
+            mHintStats->DoHint(kCameraLaunchHint, std::chrono::seconds(1));
+        }
+    }
+
+    if (mode != CAMERA_STREAMING_OFF) {
+        mHintStats->DoHint(kCamStreamingHint[mode]);
     }
+
+    mCameraStreamingMode = mode;
+    const auto prop = (mCameraStreamingMode == CAMERA_STREAMING_OFF)
+                              ? ""
+                              : kCamStreamingHint[mode].c_str();
+    if (!android::base::SetProperty(kPowerHalStateProp, prop)) {
+        ALOGE("%s: could set powerHAL state %s property", __func__, prop);
+    }
+}
+
+void Power::handleAudioStreaming(const HintDispatch &entry, int32_t data) {
+    if (data == static_cast<int32_t>(AUDIO_STREAMING_HINT::AUDIO_STREAMING_ON)) {
+        mHintStats->DoHint(entry.name);
+    } else if (data == static_cast<int32_t>(AUDIO_STREAMING_HINT::AUDIO_STREAMING_OFF)) {
+        mHintStats->EndHint(entry.name);
+    } else if (data == static_cast<int32_t>(AUDIO_STREAMING_HINT::TPU_BOOST_SHORT)) {
+        mHintStats->DoHint(kTpuBoostHint,
+                           std::chrono::milliseconds(TPU_HINT_DURATION_MS::SHORT));
+    } else if (data == static_cast<int32_t>(AUDIO_STREAMING_HINT::TPU_BOOST_LONG)) {
+        mHintStats->DoHint(kTpuBoostHint, std::chrono::milliseconds(TPU_HINT_DURATION_MS::LONG));
+    } else if (data == static_cast<int32_t>(AUDIO_STREAMING_HINT::TPU_BOOST_OFF)) {
+        mHintStats->EndHint(kTpuBoostHint);
+    } else {
+        ALOGE("AUDIO STREAMING INVALID DATA: %d", data);
+    }
+}
+
+// Methods from ::android::hardware::power::V1_0::IPower follow.
+Return<void> Power::setInteractive(bool /* interactive */) {
+    return Void();
+}
+
+Return<void> Power::powerHint(PowerHint_1_0 hint, int32_t data) {
+    dispatchHint(static_cast<PowerHint_1_3>(hint), data);
     return Void();
 }
 
@@ -237,123 +430,13 @@ Return<void> Power::powerHintAsync(PowerHint_1_0 hint, int32_t data) {
 
 // Methods from ::android::hardware::power::V1_2::IPower follow.
 Return<void> Power::powerHintAsync_1_2(PowerHint_1_2 hint, int32_t data) {
-    if (!mReady) {
-        return Void();
-    }
-
-    ATRACE_INT(android::hardware::power::V1_2::toString(hint).c_str(), data);
-    ALOGD_IF(hint >= PowerHint_1_2::AUDIO_STREAMING, "%s: %d",
-             android::hardware::power::V1_2::toString(hint).c_str(), static_cast<int>(data));
-
-    switch (hint) {
-        case PowerHint_1_2::AUDIO_LOW_LATENCY:
-            if (data) {
-                // Hint until canceled
-                mHintManager->DoHint("AUDIO_LOW_LATENCY");
-            } else {
-                mHintManager->EndHint("AUDIO_LOW_LATENCY");
-            }
-            break;
-        case PowerHint_1_2::AUDIO_STREAMING:
-            if (mVRModeOn || mSustainedPerfModeOn) {
-                ALOGV("%s: ignoring due to other active perf hints", __func__);
-            } else {
-                if (data == static_cast<int32_t>(AUDIO_STREAMING_HINT::AUDIO_STREAMING_ON)) {
-                    mHintManager->DoHint("AUDIO_STREAMING");
-                } else if (data ==
-                           static_cast<int32_t>(AUDIO_STREAMING_HINT::AUDIO_STREAMING_OFF)) {
-                    mHintManager->EndHint("AUDIO_STREAMING");
-                } else if (data == static_cast<int32_t>(AUDIO_STREAMING_HINT::TPU_BOOST_SHORT)) {
-                    mHintManager->DoHint("TPU_BOOST",
-                                         std::chrono::milliseconds(TPU_HINT_DURATION_MS::SHORT));
-                } else if (data == static_cast<int32_t>(AUDIO_STREAMING_HINT::TPU_BOOST_LONG)) {
-                    mHintManager->DoHint("TPU_BOOST",
-                                         std::chrono::milliseconds(TPU_HINT_DURATION_MS::LONG));
-                } else if (data == static_cast<int32_t>(AUDIO_STREAMING_HINT::TPU_BOOST_OFF)) {
-                    mHintManager->EndHint("TPU_BOOST");
-                } else {
-                    ALOGE("AUDIO STREAMING INVALID DATA: %d", data);
-                }
-            }
-            break;
-        case PowerHint_1_2::CAMERA_LAUNCH:
-            if (data > 0) {
-                mHintManager->DoHint("CAMERA_LAUNCH");
-            } else if (data == 0) {
-                mHintManager->EndHint("CAMERA_LAUNCH");
-            } else {
-                ALOGE("CAMERA LAUNCH INVALID DATA: %d", data);
-            }
-            break;
-        case PowerHint_1_2::CAMERA_STREAMING: {
-            const enum CameraStreamingMode mode = static_cast<enum CameraStreamingMode>(data);
-            if (mode < CAMERA_STREAMING_OFF || mode >= CAMERA_STREAMING_MAX) {
-                ALOGE("CAMERA STREAMING INVALID Mode: %d", mode);
-                break;
-            }
-
-            if (mCameraStreamingMode == mode)
-                break;
-
-            // turn it off first if any previous hint.
-            if ((mCameraStreamingMode != CAMERA_STREAMING_OFF)) {
-                const auto modeValue = kCamStreamingHint.at(mCameraStreamingMode);
-                mHintManager->EndHint(modeValue);
-                if ((mCameraStreamingMode != CAMERA_STREAMING_SECURE)) {
-                    // Boost 1s for tear down if not secure streaming use case
-                    mHintManager->DoHint("CAMERA_LAUNCH", std::chrono::seconds(1));
-                }
-            }
-
-            if (mode != CAMERA_STREAMING_OFF) {
-                const auto hintValue = kCamStreamingHint.at(mode);
-                mHintManager->DoHint(hintValue);
-            }
-
-            mCameraStreamingMode = mode;
-            const auto prop = (mCameraStreamingMode == CAMERA_STREAMING_OFF)
-                                  ? ""
-                                  : kCamStreamingHint.at(mode).c_str();
-            if (!android::base::SetProperty(kPowerHalStateProp, prop)) {
-                ALOGE("%s: could set powerHAL state %s property", __func__, prop);
-            }
-            break;
-        }
-        case PowerHint_1_2::CAMERA_SHOT:
-            if (data > 0) {
-                mHintManager->DoHint("CAMERA_SHOT", std::chrono::milliseconds(data));
-            } else if (data == 0) {
-                mHintManager->EndHint("CAMERA_SHOT");
-            } else {
-                ALOGE("CAMERA SHOT INVALID DATA: %d", data);
-            }
-            break;
-        default:
-            return powerHint(static_cast<PowerHint_1_0>(hint), data);
-    }
+    dispatchHint(static_cast<PowerHint_1_3>(hint), data);
     return Void();
 }
 
 // Methods from ::android::hardware::power::V1_3::IPower follow.
 Return<void> Power::powerHintAsync_1_3(PowerHint_1_3 hint, int32_t data) {
-    if (!mReady) {
-        return Void();
-    }
-
-    if (hint == PowerHint_1_3::EXPENSIVE_RENDERING) {
-        ATRACE_INT(android::hardware::power::V1_3::toString(hint).c_str(), data);
-        if (mVRModeOn || mSustainedPerfModeOn) {
-            ALOGV("%s: ignoring due to other active perf hints", __func__);
-        } else {
-            if (data > 0) {
-                mHintManager->DoHint("EXPENSIVE_RENDERING");
-            } else {
-                mHintManager->EndHint("EXPENSIVE_RENDERING");
-            }
-        }
-    } else {
-        return powerHintAsync_1_2(static_cast<PowerHint_1_2>(hint), data);
-    }
+    dispatchHint(hint, data);
     return Void();
 }
 
@@ -370,11 +453,29 @@ Return<void> Power::debug(const hidl_handle &handle, const hidl_vec<hidl_string>
             "VRMode: %s\n"
             "CameraStreamingMode: %s\n"
             "SustainedPerformanceMode: %s\n",
-            boolToString(mHintManager->IsRunning()), boolToString(mVRModeOn),
-            kCamStreamingHint.at(mCameraStreamingMode).c_str(),
+            boolToString(mHintStats->IsRunning()), boolToString(mVRModeOn),
+            kCamStreamingHint[mCameraStreamingMode].c_str(),
             boolToString(mSustainedPerfModeOn)));
+        if (mRenderingBoost) {
+            mRenderingBoost->Dump(&buf);
+        }
+        mHintStats->Dump(&buf);
+        buf.append("PowerHints:\n");
+        for (size_t index = 0; index < kNumHints; ++index) {
+            const uint64_t count = mHintCount[index].load(std::memory_order_relaxed);
+            if (count == 0) {
+                continue;
+            }
+            android::base::StringAppendF(&buf, " %s Count: %" PRIu64,
+                                         kHintDispatch[index].name.c_str(), count);
+            if (kHintDispatch[index].handler != nullptr) {
+                buf.append(" Handler latency: ");
+                mHintLatency[index].Dump(&buf);
+            }
+            buf.append("\n");
+        }
         // Dump nodes through libperfmgr
-        mHintManager->DumpToFd(fd);
+        mHintStats->DumpToFd(fd);
         if (!android::base::WriteStringToFd(buf, fd)) {
             PLOG(ERROR) << "Failed to dump state to fd";
         }
@@ -17,8 +17,12 @@
 #ifndef POWER_LIBPERFMGR_POWER_H_
 #define POWER_LIBPERFMGR_POWER_H_
 
+#include <array>
 #include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <string>
 #include <thread>
 
 #include <android/hardware/power/1.3/IPower.h>
@@ -27,7 +31,9 @@
 #include <perfmgr/HintManager.h>
 
 #include "CameraMode.h"
+#include "HintStats.h"
 #include "InteractionHandler.h"
+#include "RenderingBoost.h"
 
 namespace android {
 namespace hardware {
@@ -70,13 +76,76 @@ class Power : public IPower {
     Return<void> debug(const hidl_handle &fd, const hidl_vec<hidl_string> &args) override;
 
   private:
-    std::shared_ptr<HintManager> mHintManager;
+    // Where the handler of a hint runs, so a slow hint does not hold up the others.
+    enum class HintExecution {
+        // On the binder thread, for handlers safe to run concurrently with the others
+        INLINE,
+        // On mHintThread, which only handles the latest pending data of each hint
+        COALESCED,
+        // On the binder thread under mSerializedHintLock, for hints whose every call matters.
+        // Their handlers must be quick and not share state with the coalesced ones.
+        SERIALIZED,
+    };
+    // Entry of the hint dispatch table, indexed by PowerHint_1_3 value. Hint names are resolved
+    // once so a hint costs a table lookup instead of building and comparing strings.
+    struct HintDispatch {
+        // Trace counter, and libperfmgr hint for the handlers which take one
+        std::string name;
+        // Ignored while VR or sustained performance mode is on
+        bool ignored_in_perf_mode;
+        HintExecution execution;
+        void (Power::*handler)(const HintDispatch &entry, int32_t data);
+    };
+    static constexpr size_t kNumHints =
+            static_cast<size_t>(PowerHint_1_3::EXPENSIVE_RENDERING) + 1;
+    static const std::array<HintDispatch, kNumHints> kHintDispatch;
+    // libperfmgr hint of each combination of sustained performance and VR modes
+    static const std::array<std::array<std::string, 2>, 2> kPerfModeHint;
+
+    void dispatchHint(PowerHint_1_3 hint, int32_t data);
+    void runHint(const HintDispatch &entry, int32_t data);
+    // Handle the pending coalesced hints, forever.
+    void hintLoop();
+    // Switch the libperfmgr hint from the current to the requested combination of modes.
+    void setPerfModes(bool sustained_perf_mode_on, bool vr_mode_on);
+    void handleInteraction(const HintDispatch &entry, int32_t data);
+    void handleSustainedPerformance(const HintDispatch &entry, int32_t data);
+    void handleVrMode(const HintDispatch &entry, int32_t data);
+    void handleLowPower(const HintDispatch &entry, int32_t data);
+    // Do the hint of the entry while data is non zero
+    void handleBoost(const HintDispatch &entry, int32_t data);
+    // Closed loop boost while data is non zero, static hint if the config has no levels
+    void handleExpensiveRendering(const HintDispatch &entry, int32_t data);
+    // Do the hint of the entry while data is positive, end it on 0
+    void handleCameraLaunch(const HintDispatch &entry, int32_t data);
+    // Do the hint of the entry for data ms, end it on 0
+    void handleCameraShot(const HintDispatch &entry, int32_t data);
+    void handleCameraStreaming(const HintDispatch &entry, int32_t data);
+    void handleAudioStreaming(const HintDispatch &entry, int32_t data);
+
+    std::shared_ptr<HintStats> mHintStats;
     std::unique_ptr<InteractionHandler> mInteractionHandler;
+    // Null when the config has no EXPENSIVE_RENDERING levels
+    std::unique_ptr<RenderingBoost> mRenderingBoost;
     std::atomic<bool> mVRModeOn;
     std::atomic<bool> mSustainedPerfModeOn;
     std::atomic<enum CameraStreamingMode> mCameraStreamingMode;
     std::atomic<bool> mReady;
     std::thread mInitThread;
+
+    // Serializes the SERIALIZED handlers, independently of mHintThread
+    std::mutex mSerializedHintLock;
+    // Coalesced hints: latest data of each hint, and a bit per hint with data pending, kept until
+    // mReady. Binder threads only wait for mHintThread when waking it up.
+    std::array<std::atomic<int32_t>, kNumHints> mPendingHintData;
+    std::atomic<uint32_t> mPendingHints;
+    std::mutex mHintThreadLock;
+    std::condition_variable mHintThreadCond;
+    std::thread mHintThread;
+
+    // Calls of each hint, and latency of its handler
+    std::array<std::atomic<uint64_t>, kNumHints> mHintCount;
+    std::array<LatencyHistogram, kNumHints> mHintLatency;
 };
 
 }  // namespace implementation
@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.power@1.3-service.pixel-libperfmgr"
+#define ATRACE_TAG (ATRACE_TAG_POWER | ATRACE_TAG_HAL)
+
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <utils/Log.h>
+#include <utils/Trace.h>
+#include <algorithm>
+#include <chrono>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+
+#include "RenderingBoost.h"
+
+// The loads are sampled every kSampleMs. A sample over kHighLoadPercent steps the boost up, and
+// kLowLoadSamples consecutive samples under kLowLoadPercent step it down, so the boost follows
+// a rising load quickly and a falling one with some hysteresis.
+static constexpr std::chrono::milliseconds kSampleMs(100);
+static constexpr int kHighLoadPercent = 90;
+static constexpr int kLowLoadPercent = 60;
+static constexpr size_t kLowLoadSamples = 5;
+
+static constexpr char kProcStatPath[] = "/proc/stat";
+static constexpr char kCpufreqPath[] = "/sys/devices/system/cpu/cpufreq";
+static constexpr char kGpuLoadPath[] = "/sys/class/kgsl/kgsl-3d0/gpu_busy_percentage";
+
+std::string RenderingBoost::LevelHint(size_t level) {
+    return android::base::StringPrintf("EXPENSIVE_RENDERING_%zu", level);
+}
+
+RenderingBoost::RenderingBoost(std::shared_ptr<HintStats> const &hint_stats)
+    : mInitialized(false),
+      mActive(false),
+      mLevel(0),
+      mLowLoadSamples(0),
+      mNumClusters(1),
+      mHintStats(hint_stats) {}
+
+RenderingBoost::~RenderingBoost() {
+    Exit();
+}
+
+bool RenderingBoost::Init() {
+    std::lock_guard<std::mutex> lk(mLock);
+    if (mInitialized)
+        return true;
+
+    mLevelHints.assign(1, "");
+    while (mLevelHints.size() <= kMaxLevels &&
+           mHintStats->IsHintSupported(LevelHint(mLevelHints.size()))) {
+        mLevelHints.emplace_back(LevelHint(mLevelHints.size()));
+    }
+    if (mLevelHints.size() == 1) {
+        ALOGI("%s: no %s hint, closed loop rendering boost disabled", __func__,
+              LevelHint(1).c_str());
+        return false;
+    }
+
+    mStatFd.reset(open(kProcStatPath, O_RDONLY | O_CLOEXEC));
+    if (mStatFd < 0) {
+        ALOGE("Unable to open %s (%d)", kProcStatPath, errno);
+        return false;
+    }
+    ReadCpuClusters();
+    // Optional, the CPU load alone drives the boost without it
+    mGpuLoadFd.reset(open(kGpuLoadPath, O_RDONLY | O_CLOEXEC));
+    if (mGpuLoadFd < 0) {
+        ALOGW("Unable to open %s (%d)", kGpuLoadPath, errno);
+    }
+
+    mInitialized = true;
+    mThread = std::unique_ptr<std::thread>(new std::thread(&RenderingBoost::Routine, this));
+    return true;
+}
+
+void RenderingBoost::Exit() {
+    std::unique_lock<std::mutex> lk(mLock);
+    if (!mInitialized)
+        return;
+
+    mInitialized = false;
+    mActive = false;
+    SetLevelLocked(0);
+    lk.unlock();
+
+    mCond.notify_all();
+    mThread->join();
+}
+
+void RenderingBoost::SetActive(bool active) {
+    std::lock_guard<std::mutex> lk(mLock);
+    if (!mInitialized || mActive == active)
+        return;
+
+    mActive = active;
+    mLowLoadSamples = 0;
+    // Start from the first level, the samples take it where the load needs it
+    SetLevelLocked(active ? 1 : 0);
+    mCond.notify_one();
+}
+
+void RenderingBoost::Dump(std::string *out) {
+    std::lock_guard<std::mutex> lk(mLock);
+    android::base::StringAppendF(out, "ExpensiveRenderingLevel: %zu/%zu%s\n", mLevel,
+                                 mLevelHints.size() - 1, mActive ? " (active)" : "");
+}
+
+// should be called while locked
+void RenderingBoost::SetLevelLocked(size_t level) {
+    if (level == mLevel)
+        return;
+
+    // Take the new level before dropping the old one, so the boost has no gap
+    if (level > 0 && !mHintStats->DoHint(mLevelHints[level])) {
+        ALOGE("%s: do hint %s failed", __func__, mLevelHints[level].c_str());
+    }
+    if (mLevel > 0 && !mHintStats->EndHint(mLevelHints[mLevel])) {
+        ALOGE("%s: end hint %s failed", __func__, mLevelHints[mLevel].c_str());
+    }
+    mLevel = level;
+    ATRACE_INT("expensive_rendering_level", static_cast<int32_t>(level));
+}
+
+void RenderingBoost::ReadCpuClusters() {
+    mCpuCluster.clear();
+    mNumClusters = 1;
+    std::unique_ptr<DIR, int (*)(DIR *)> dir(opendir(kCpufreqPath), closedir);
+    if (!dir) {
+        ALOGW("Unable to open %s (%d), CPU load over all CPUs", kCpufreqPath, errno);
+        return;
+    }
+    size_t num_clusters = 0;
+    while (struct dirent *ent = readdir(dir.get())) {
+        if (strncmp(ent->d_name, "policy", 6) != 0)
+            continue;
+        // e.g. "4 5 6 7"
+        std::string cpus;
+        if (!android::base::ReadFileToString(
+                    android::base::StringPrintf("%s/%s/related_cpus", kCpufreqPath, ent->d_name),
+                    &cpus))
+            continue;
+        const char *p = cpus.c_str();
+        char *end;
+        for (unsigned long cpu = strtoul(p, &end, 10); end != p; cpu = strtoul(p, &end, 10)) {
+            if (cpu >= mCpuCluster.size())
+                mCpuCluster.resize(cpu + 1, 0);
+            mCpuCluster[cpu] = num_clusters;
+            p = end;
+        }
+        ++num_clusters;
+    }
+    mNumClusters = std::max<size_t>(num_clusters, 1);
+}
+
+int RenderingBoost::ReadCpuLoad() {
+    // The per CPU lines come first, the rest of the file is not needed
+    char buf[4096];
+    const ssize_t len = pread(mStatFd, buf, sizeof(buf) - 1, 0);
+    if (len <= 0) {
+        ALOGE("%s: failed to read %s (%d)", __func__, kProcStatPath, errno);
+        return -1;
+    }
+    buf[len] = '\0';
+
+    // Busy and total jiffies of each cluster since the previous sample
+    std::vector<std::pair<uint64_t, uint64_t>> deltas(mNumClusters, {0, 0});
+    char *saveptr;
+    for (char *line = strtok_r(buf, "\n", &saveptr); line != nullptr;
+         line = strtok_r(nullptr, "\n", &saveptr)) {
+        if (strncmp(line, "cpu", 3) != 0)
+            break;
+        // Skip the line summing all CPUs
+        if (!isdigit(line[3]))
+            continue;
+        unsigned int cpu;
+        uint64_t user, nice, system, idle, iowait, irq, softirq, steal;
+        if (sscanf(line,
+                   "cpu%u %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+                   " %" SCNu64 " %" SCNu64,
+                   &cpu, &user, &nice, &system, &idle, &iowait, &irq, &softirq, &steal) != 9)
+            continue;
+
+        // Offline CPUs have no line, keep the times by CPU number
+        if (cpu >= mCpuTimes.size())
+            mCpuTimes.resize(cpu + 1, {0, 0});
+        const uint64_t total = user + nice + system + idle + iowait + irq + softirq + steal;
+        const uint64_t busy = total - idle - iowait;
+        auto &prev = mCpuTimes[cpu];
+        if (prev.second != 0 && total > prev.second && busy >= prev.first) {
+            auto &delta = deltas[cpu < mCpuCluster.size() ? mCpuCluster[cpu] : 0];
+            delta.first += busy - prev.first;
+            delta.second += total - prev.second;
+        }
+        prev = {busy, total};
+    }
+
+    int max_load = -1;
+    for (const auto &delta : deltas) {
+        if (delta.second != 0)
+            max_load = std::max(max_load, static_cast<int>(delta.first * 100 / delta.second));
+    }
+    return max_load;
+}
+
+int RenderingBoost::ReadGpuLoad() {
+    if (mGpuLoadFd < 0)
+        return -1;
+
+    // e.g. "42 %"
+    char buf[32];
+    const ssize_t len = pread(mGpuLoadFd, buf, sizeof(buf) - 1, 0);
+    if (len <= 0) {
+        ALOGE("%s: failed to read %s (%d)", __func__, kGpuLoadPath, errno);
+        return -1;
+    }
+    buf[len] = '\0';
+    return atoi(buf);
+}
+
+void RenderingBoost::Routine() {
+    std::unique_lock<std::mutex> lk(mLock);
+    while (mInitialized) {
+        if (!mActive) {
+            mCond.wait(lk);
+            // The CPU times at activation are the base of the first sample
+            mCpuTimes.clear();
+            ReadCpuLoad();
+            continue;
+        }
+        if (mCond.wait_for(lk, kSampleMs, [this] { return !mActive || !mInitialized; }))
+            continue;
+
+        const int load = std::max(ReadCpuLoad(), ReadGpuLoad());
+        ATRACE_INT("expensive_rendering_load", load);
+        if (load < 0)
+            continue;
+        if (load >= kHighLoadPercent) {
+            mLowLoadSamples = 0;
+            if (mLevel + 1 < mLevelHints.size())
+                SetLevelLocked(mLevel + 1);
+        } else if (load < kLowLoadPercent) {
+            if (++mLowLoadSamples >= kLowLoadSamples && mLevel > 0) {
+                mLowLoadSamples = 0;
+                SetLevelLocked(mLevel - 1);
+            }
+        } else {
+            mLowLoadSamples = 0;
+        }
+    }
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef POWER_LIBPERFMGR_RENDERINGBOOST_H_
+#define POWER_LIBPERFMGR_RENDERINGBOOST_H_
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/unique_fd.h>
+
+#include "HintStats.h"
+
+// Closed loop boost for EXPENSIVE_RENDERING. While active, samples the GPU and CPU loads and
+// holds the lowest of the EXPENSIVE_RENDERING_<level> hints keeping them below saturation,
+// down to no hint at all when the load drops.
+// The CPU load is that of the busiest cpufreq policy, averaged over its CPUs, so a background
+// thread spinning on one CPU of a cluster does not read as saturation. It is not attributed to
+// the rendering threads though: a policy with a single CPU, or a busy background workload
+// spread over a whole cluster, still raises the boost.
+class RenderingBoost {
+  public:
+    // Levels looked up in the config, EXPENSIVE_RENDERING_1 to EXPENSIVE_RENDERING_<kMaxLevels>
+    static constexpr size_t kMaxLevels = 4;
+    static std::string LevelHint(size_t level);
+
+    RenderingBoost(std::shared_ptr<HintStats> const &hint_stats);
+    ~RenderingBoost();
+    // Return false if the config has no level hints, EXPENSIVE_RENDERING stays static then.
+    bool Init();
+    void Exit();
+    void SetActive(bool active);
+    void Dump(std::string *out);
+
+  private:
+    void Routine();
+    // Map each CPU to its cpufreq policy, all CPUs in one when cpufreq is missing
+    void ReadCpuClusters();
+    // Return the busiest cpufreq policy load and the GPU load in percent, -1 when unknown
+    int ReadCpuLoad();
+    int ReadGpuLoad();
+    void SetLevelLocked(size_t level);
+
+    // Hint of each level, level 0 is no hint
+    std::vector<std::string> mLevelHints;
+    bool mInitialized;
+    bool mActive;
+    size_t mLevel;
+    // Consecutive samples under the lower load threshold
+    size_t mLowLoadSamples;
+
+    android::base::unique_fd mStatFd;
+    android::base::unique_fd mGpuLoadFd;
+    // Busy and total jiffies of each CPU at the previous sample
+    std::vector<std::pair<uint64_t, uint64_t>> mCpuTimes;
+    // cpufreq policy index of each CPU, and the number of policies
+    std::vector<size_t> mCpuCluster;
+    size_t mNumClusters;
+
+    std::unique_ptr<std::thread> mThread;
+    std::mutex mLock;
+    std::condition_variable mCond;
+    std::shared_ptr<HintStats> mHintStats;
+};
+
+#endif  // POWER_LIBPERFMGR_RENDERINGBOOST_H_
@@ -21,12 +21,20 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 #include <cutils/sockets.h>
 #include <log/log.h>
 
@@ -34,21 +42,50 @@
 
 #define DAEMON_SOCKET "pps"
 
+// Reconnection backoff, attempts before giving up on a request until the next one, and how long
+// a send may wait for room in the socket buffer
+static constexpr std::chrono::milliseconds kMinBackoff(100);
+static constexpr std::chrono::milliseconds kMaxBackoff(10000);
+static constexpr int kMaxAttempts = 5;
+static constexpr int kSendTimeoutMs = 1000;
+
+// Only touched by the ppd thread. The state last sent on the current connection, a new
+// connection may be to a restarted daemon.
 static int daemon_socket = -1;
+static enum display_lpm_state delivered_lpm = DISPLAY_LPM_UNKNOWN;
+
+// The state last requested by set_display_lpm(), and whether it is still to be sent. The ppd
+// thread only sends the latest request, so toggles queued behind a send are coalesced. The lock
+// and condition are never destroyed, the ppd thread may still wait on them at exit.
+static std::mutex &ppd_lock = *new std::mutex();
+static std::condition_variable &ppd_cond = *new std::condition_variable();
+static enum display_lpm_state requested_lpm = DISPLAY_LPM_UNKNOWN;
+static bool ppd_pending = false;
 
 static int connectPPDaemon() {
     // Setup socket connection, if not already done.
-    if (daemon_socket < 0)
-        daemon_socket =
-                socket_local_client(DAEMON_SOCKET, ANDROID_SOCKET_NAMESPACE_RESERVED, SOCK_STREAM);
+    if (daemon_socket >= 0)
+        return 0;
 
+    daemon_socket =
+            socket_local_client(DAEMON_SOCKET, ANDROID_SOCKET_NAMESPACE_RESERVED, SOCK_STREAM);
     if (daemon_socket < 0) {
         ALOGE("Connecting to socket failed: %s", strerror(errno));
         return -1;
     }
+    if (fcntl(daemon_socket, F_SETFL, fcntl(daemon_socket, F_GETFL) | O_NONBLOCK) < 0) {
+        ALOGE("Failed to make socket non-blocking: %s", strerror(errno));
+    }
+    delivered_lpm = DISPLAY_LPM_UNKNOWN;
     return 0;
 }
 
+static void disconnectPPDaemon() {
+    close(daemon_socket);
+    daemon_socket = -1;
+    delivered_lpm = DISPLAY_LPM_UNKNOWN;
+}
+
 static int ppdComm(const char *cmd) {
     int ret = -1;
 
@@ -56,19 +93,78 @@ static int ppdComm(const char *cmd) {
     if (ret < 0)
         return ret;
 
-    ret = write(daemon_socket, cmd, strlen(cmd));
-    if (ret < 0) {
+    const size_t len = strlen(cmd);
+    size_t sent = 0;
+    while (sent < len) {
+        // MSG_NOSIGNAL: a daemon restart must not SIGPIPE the HAL
+        ssize_t n = send(daemon_socket, cmd + sent, len - sent, MSG_NOSIGNAL);
+        if (n >= 0) {
+            sent += n;
+            continue;
+        }
+        if (errno == EINTR)
+            continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            struct pollfd pfd = {.fd = daemon_socket, .events = POLLOUT, .revents = 0};
+            if (TEMP_FAILURE_RETRY(poll(&pfd, 1, kSendTimeoutMs)) > 0)
+                continue;
+            errno = ETIMEDOUT;
+        }
+        // Reconnect rather than leave a partial command in the stream
         ALOGE("Failed to send data over socket, %s", strerror(errno));
-        return ret;
+        disconnectPPDaemon();
+        return -1;
     }
     return 0;
 }
 
+static void ppdLoop() {
+    std::chrono::milliseconds backoff = kMinBackoff;
+    int attempts = 0;
+    std::unique_lock<std::mutex> lock(ppd_lock);
+    while (true) {
+        ppd_cond.wait(lock, [] { return ppd_pending; });
+        const enum display_lpm_state lpm = requested_lpm;
+        ppd_pending = false;
+        lock.unlock();
+        if (lpm == delivered_lpm) {
+            // Toggled back before the previous state was replaced
+            attempts = 0;
+            backoff = kMinBackoff;
+            lock.lock();
+            continue;
+        }
+        const int ret = ppdComm(lpm == DISPLAY_LPM_ON ? "foss:on" : "foss:off");
+        if (ret < 0) {
+            std::this_thread::sleep_for(backoff);
+            backoff = std::min(backoff * 2, kMaxBackoff);
+        } else {
+            delivered_lpm = lpm;
+            backoff = kMinBackoff;
+        }
+        lock.lock();
+        if (ret == 0 || ppd_pending) {
+            // Delivered, or superseded by a newer request which gets its own attempts
+            attempts = 0;
+        } else if (++attempts < kMaxAttempts) {
+            // Retry on a new connection
+            ppd_pending = true;
+        } else {
+            ALOGE("Giving up on display LPM state %d until the next request", lpm);
+            attempts = 0;
+            backoff = kMinBackoff;
+        }
+    }
+}
+
 void set_display_lpm(int enable) {
+    static std::once_flag ppd_thread_once;
     ALOGI("set_display_lpm state: %d", enable);
-    if (enable) {
-        ppdComm("foss:on");
-    } else {
-        ppdComm("foss:off");
+    std::call_once(ppd_thread_once, [] { std::thread(ppdLoop).detach(); });
+    {
+        std::lock_guard<std::mutex> lock(ppd_lock);
+        requested_lpm = enable ? DISPLAY_LPM_ON : DISPLAY_LPM_OFF;
+        ppd_pending = true;
     }
+    ppd_cond.notify_one();
 }
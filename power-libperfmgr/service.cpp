@@ -33,6 +33,11 @@ using android::hardware::joinRpcThreadpool;
 using android::hardware::power::V1_3::IPower;
 using android::hardware::power::V1_3::implementation::Power;
 
+// Binder threads, including the main thread. powerHint is oneway, so its calls are delivered one
+// at a time whatever the count; the other threads keep debug and the get*Stats calls from
+// waiting behind a hint.
+constexpr size_t kRpcThreads = 4;
+
 int main(int /* argc */, char ** /* argv */) {
     ALOGI("Power HAL Service 1.3 for Pixel is starting.");
 
@@ -42,7 +47,7 @@ int main(int /* argc */, char ** /* argv */) {
         return 1;
     }
     android::hardware::setMinSchedulerPolicy(service, SCHED_NORMAL, -20);
-    configureRpcThreadpool(1, true /*callerWillJoin*/);
+    configureRpcThreadpool(kRpcThreads, true /*callerWillJoin*/);
 
     status_t status = service->registerAsService();
     if (status != OK) {
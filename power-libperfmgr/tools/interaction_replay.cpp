@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Replay a recorded touch trace through InteractionHandler on the host, to evaluate interaction
+// boost heuristics before they reach devices.
+//
+// Usage: interaction_replay <trace.csv> [acquire_benchmark_calls]
+//
+// The trace has one "time_ms,event" line per event, where event is "touch <duration_ms>" for an
+// INTERACTION hint, or "busy" / "idle" for a display idle state transition. Lines starting with
+// '#' are comments. The trace is replayed in real time against a fake display idle source, and
+// the hints go to a fake HintSink recording the calls. The tool reports the boosts started,
+// the total boosted time and the boost on latency, then benchmarks Acquire() calls.
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+#include <android-base/strings.h>
+
+#include "InteractionHandler.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Over the longest boost InteractionHandler does
+constexpr int32_t kMaxDurationMs = 10000;
+
+enum class EventType { TOUCH, BUSY, IDLE };
+
+struct TraceEvent {
+    int64_t time_ms;
+    EventType type;
+    int32_t duration_ms;
+};
+
+bool parseTrace(const std::string &trace_path, std::vector<TraceEvent> *trace) {
+    std::string data;
+    if (!android::base::ReadFileToString(trace_path, &data)) {
+        PLOG(ERROR) << "Failed to read trace " << trace_path;
+        return false;
+    }
+    std::vector<std::string> lines = android::base::Split(data, "\n");
+    for (size_t i = 0; i < lines.size(); ++i) {
+        const std::string line = android::base::Trim(lines[i]);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::vector<std::string> fields = android::base::Split(line, ",");
+        TraceEvent event = {0, EventType::TOUCH, 0};
+        bool valid = fields.size() == 2 &&
+                     android::base::ParseInt(android::base::Trim(fields[0]), &event.time_ms,
+                                             int64_t(0)) &&
+                     (trace->empty() || event.time_ms >= trace->back().time_ms);
+        if (valid) {
+            std::vector<std::string> args =
+                    android::base::Split(android::base::Trim(fields[1]), " ");
+            if (args[0] == "touch" && args.size() == 2) {
+                valid = android::base::ParseInt(args[1], &event.duration_ms, 0);
+            } else if (args[0] == "busy" && args.size() == 1) {
+                event.type = EventType::BUSY;
+            } else if (args[0] == "idle" && args.size() == 1) {
+                event.type = EventType::IDLE;
+            } else {
+                valid = false;
+            }
+        }
+        if (!valid) {
+            LOG(ERROR) << trace_path << ":" << i + 1 << ": invalid event";
+            return false;
+        }
+        trace->emplace_back(event);
+    }
+    if (trace->empty()) {
+        LOG(ERROR) << trace_path << ": no events";
+        return false;
+    }
+    return true;
+}
+
+// Display idle state set by the replay, signaling transitions to idle through an eventfd.
+class FakeIdleSource : public DisplayIdleSource {
+  public:
+    FakeIdleSource() : mFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), mIdle(true) {}
+
+    void SetIdle(bool idle) {
+        if (idle && !mIdle.exchange(idle)) {
+            uint64_t val = 1;
+            if (write(mFd, &val, sizeof(val)) != sizeof(val)) {
+                PLOG(ERROR) << "Failed to signal idle";
+            }
+        }
+        mIdle = idle;
+    }
+    enum display_idle_state ReadState() override {
+        uint64_t val;
+        // Nothing to read unless a transition is pending
+        if (read(mFd, &val, sizeof(val)) < 0 && errno != EAGAIN) {
+            PLOG(ERROR) << "Failed to read idle transitions";
+            return DISPLAY_IDLE_STATE_ERROR;
+        }
+        return mIdle ? DISPLAY_IDLE_STATE_IDLE : DISPLAY_IDLE_STATE_BUSY;
+    }
+    int GetFd() const override { return mFd; }
+    short GetEvents() const override { return POLLIN; }
+
+  private:
+    android::base::unique_fd mFd;
+    std::atomic<bool> mIdle;
+};
+
+// Records the hint calls instead of applying them, INTERACTION is the only hint
+// InteractionHandler does.
+class FakeHintSink : public HintSink {
+  public:
+    bool DoHint(const std::string &) override {
+        std::lock_guard<std::mutex> lock(mLock);
+        mLastDoHint = Clock::now();
+        if (!mBoosted) {
+            ++mBoosts;
+            mBoosted = true;
+            mBoostStart = mLastDoHint;
+        }
+        return true;
+    }
+    bool DoHint(const std::string &hint, std::chrono::milliseconds) override {
+        return DoHint(hint);
+    }
+    bool EndHint(const std::string &) override {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (mBoosted) {
+            mBoosted = false;
+            mBoostedTime += Clock::now() - mBoostStart;
+        }
+        return true;
+    }
+    bool IsRunning() const override { return true; }
+    bool IsHintSupported(const std::string &) const override { return true; }
+    void DumpToFd(int) override {}
+
+    size_t GetBoostCount() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mBoosts;
+    }
+    Clock::time_point GetLastDoHint() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mLastDoHint;
+    }
+    Clock::duration GetBoostedTime(Clock::time_point now) {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mBoostedTime + (mBoosted ? now - mBoostStart : Clock::duration::zero());
+    }
+
+  private:
+    std::mutex mLock;
+    size_t mBoosts = 0;
+    bool mBoosted = false;
+    Clock::time_point mBoostStart;
+    Clock::duration mBoostedTime = Clock::duration::zero();
+    Clock::time_point mLastDoHint;
+};
+
+// Return the time per Acquire(duration_ms) call in ns
+int64_t benchmarkAcquire(InteractionHandler *handler, int32_t duration_ms, size_t calls) {
+    const Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < calls; ++i) {
+        handler->Acquire(duration_ms);
+    }
+    const auto ns =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    return calls > 0 ? ns / static_cast<int64_t>(calls) : 0;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    android::base::InitLogging(argv, android::base::StderrLogger);
+    if (argc != 2 && argc != 3) {
+        LOG(ERROR) << "Usage: " << argv[0] << " <trace.csv> [acquire_benchmark_calls]";
+        return 1;
+    }
+    std::vector<TraceEvent> trace;
+    if (!parseTrace(argv[1], &trace)) {
+        return 1;
+    }
+    size_t benchmark_calls = 1000000;
+    if (argc == 3 && !android::base::ParseUint(argv[2], &benchmark_calls)) {
+        LOG(ERROR) << "Invalid number of calls " << argv[2];
+        return 1;
+    }
+
+    auto hint_sink = std::make_shared<FakeHintSink>();
+    auto hint_stats =
+            std::make_shared<HintStats>(hint_sink, std::vector<std::string>{"INTERACTION"});
+    auto idle_source = std::make_unique<FakeIdleSource>();
+    FakeIdleSource *idle = idle_source.get();
+    InteractionHandler handler(hint_stats, std::move(idle_source));
+    if (!handler.Init()) {
+        LOG(ERROR) << "Failed to initialize InteractionHandler";
+        return 1;
+    }
+
+    // Replay in real time, InteractionHandler runs on CLOCK_MONOTONIC
+    LatencyHistogram boost_on_latency;
+    size_t num_touches = 0;
+    const Clock::time_point start = Clock::now();
+    for (const auto &event : trace) {
+        std::this_thread::sleep_until(start + std::chrono::milliseconds(event.time_ms));
+        switch (event.type) {
+            case EventType::TOUCH: {
+                const size_t prev_boosts = hint_sink->GetBoostCount();
+                const Clock::time_point acquire_start = Clock::now();
+                handler.Acquire(event.duration_ms);
+                if (hint_sink->GetBoostCount() != prev_boosts) {
+                    boost_on_latency.Record(hint_sink->GetLastDoHint() - acquire_start);
+                }
+                ++num_touches;
+                break;
+            }
+            case EventType::BUSY:
+                idle->SetIdle(false);
+                break;
+            case EventType::IDLE:
+                idle->SetIdle(true);
+                break;
+        }
+    }
+    const Clock::time_point end = Clock::now();
+    const auto boosted_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                    hint_sink->GetBoostedTime(end))
+                                    .count();
+    const auto replay_ms =
+            std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+
+    std::cout << "Touches: " << num_touches << " Boosts: " << hint_sink->GetBoostCount()
+              << std::endl;
+    std::cout << "Boosted: " << boosted_ms << "ms of " << replay_ms << "ms ("
+              << (replay_ms > 0 ? boosted_ms * 100 / replay_ms : 0) << "%)" << std::endl;
+    std::string latency;
+    boost_on_latency.Dump(&latency);
+    std::cout << "Boost on latency: " << latency << std::endl;
+
+    // Calls covered by a long boost return early, calls with a later deadline extend the boost
+    // under the lock.
+    idle->SetIdle(false);
+    handler.Acquire(kMaxDurationMs);
+    std::cout << "Acquire covered by the boost: " << benchmarkAcquire(&handler, 0, benchmark_calls)
+              << "ns per call" << std::endl;
+    std::cout << "Acquire extending the boost: "
+              << benchmarkAcquire(&handler, kMaxDurationMs, benchmark_calls) << "ns per call"
+              << std::endl;
+    handler.Exit();
+    return 0;
+}
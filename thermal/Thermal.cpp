@@ -256,11 +256,62 @@ void Thermal::sendThermalChangedCallback(const std::vector<Temperature_2_0> &tem
     }
 }
 
-Return<void> Thermal::debug(const hidl_handle &handle, const hidl_vec<hidl_string> &) {
+void Thermal::dumpHistory(std::ostringstream *dump_buf, bool dump_records) {
+    const int64_t now_ms = thermal_helper_.GetHistoryTimeMs();
+    *dump_buf << "History:" << std::endl;
+    for (const auto &name_history_pair : thermal_helper_.GetSensorHistoryMap()) {
+        const auto records = name_history_pair.second.getRecords();
+        const HistoryStats stats = SensorHistory::getStats(records);
+        *dump_buf << " Name: " << name_history_pair.first << " Samples: " << stats.count
+                  << " Min: " << stats.min << " Max: " << stats.max << " Avg: " << stats.avg;
+        *dump_buf << " TimeInSeverityMs: [";
+        for (int64_t time_ms : name_history_pair.second.getTimeInSeverityMs(now_ms)) {
+            *dump_buf << time_ms << " ";
+        }
+        *dump_buf << "]" << std::endl;
+        if (!dump_records) {
+            continue;
+        }
+        for (const auto &record : records) {
+            *dump_buf << "  " << (record.timestamp_ms - now_ms) << "ms: " << record.value << " "
+                      << android::hardware::thermal::V2_0::toString(record.severity)
+                      << std::endl;
+        }
+    }
+}
+
+Return<void> Thermal::debug(const hidl_handle &handle, const hidl_vec<hidl_string> &args) {
     if (handle != nullptr && handle->numFds >= 1) {
         int fd = handle->data[0];
         std::ostringstream dump_buf;
 
+        if (args.size() == 1 && args[0] == "--history-binary") {
+            const int64_t now_ms = thermal_helper_.GetHistoryTimeMs();
+            std::string buf = thermal_helper_.isInitializedOk()
+                                      ? SerializeSensorHistory(
+                                                thermal_helper_.GetSensorHistoryMap(), now_ms)
+                                      : "";
+            if (!android::base::WriteStringToFd(buf, fd)) {
+                PLOG(ERROR) << "Failed to dump history to fd";
+            }
+            fsync(fd);
+            return Void();
+        }
+
+        // "--reload-config [path]" reloads the thermal config, from the boot config by default
+        if (args.size() >= 1 && args[0] == "--reload-config") {
+            const std::string config_path = args.size() >= 2 ? std::string(args[1]) : "";
+            const bool reloaded = thermal_helper_.isInitializedOk() &&
+                                  thermal_helper_.reloadConfig(config_path);
+            std::string buf = reloaded ? "Thermal config reloaded\n"
+                                       : "Failed to reload thermal config, see logcat\n";
+            if (!android::base::WriteStringToFd(buf, fd)) {
+                PLOG(ERROR) << "Failed to write reload status to fd";
+            }
+            fsync(fd);
+            return Void();
+        }
+
         if (!thermal_helper_.isInitializedOk()) {
             dump_buf << "ThermalHAL not initialized properly." << std::endl;
         } else {
@@ -354,8 +405,8 @@ Return<void> Thermal::debug(const hidl_handle &handle, const hidl_vec<hidl_strin
             }
             {
                 dump_buf << "getHysteresis:" << std::endl;
-                const auto &map = thermal_helper_.GetSensorInfoMap();
-                for (const auto &name_info_pair : map) {
+                const auto config = thermal_helper_.GetConfig();
+                for (const auto &name_info_pair : config->sensor_info_map) {
                     dump_buf << " Name: " << name_info_pair.first;
                     dump_buf << " hotHysteresis: [";
                     for (size_t i = 0; i < kThrottlingSeverityCount; ++i) {
@@ -370,13 +421,45 @@ Return<void> Thermal::debug(const hidl_handle &handle, const hidl_vec<hidl_strin
             }
             {
                 dump_buf << "Monitor:" << std::endl;
-                const auto &map = thermal_helper_.GetSensorInfoMap();
-                for (const auto &name_info_pair : map) {
+                const auto config = thermal_helper_.GetConfig();
+                for (const auto &name_info_pair : config->sensor_info_map) {
                     dump_buf << " Name: " << name_info_pair.first;
                     dump_buf << " Monitor: " << std::boolalpha << name_info_pair.second.is_monitor
                              << std::noboolalpha << std::endl;
                 }
             }
+            {
+                dump_buf << "Notifications:" << std::endl;
+                const auto config = thermal_helper_.GetConfig();
+                for (const auto &name_status_pair : thermal_helper_.GetSensorStatusMap()) {
+                    const auto &sensor_info = config->sensor_info_map.at(name_status_pair.first);
+                    if (!sensor_info.is_monitor) {
+                        continue;
+                    }
+                    const SensorStatus &sensor_status = name_status_pair.second;
+                    dump_buf << " Name: " << name_status_pair.first
+                             << " IntervalMs: " << sensor_info.notification_interval.count()
+                             << " Sent: " << sensor_status.notification_count
+                             << " Suppressed: " << sensor_status.suppressed_notification_count
+                             << " Pending: " << std::boolalpha
+                             << sensor_status.notification_pending << std::noboolalpha
+                             << std::endl;
+                }
+            }
+            {
+                dump_buf << "CoolingDeviceResidency:" << std::endl;
+                for (const auto &name_status_pair : thermal_helper_.GetCoolingDeviceStatusMap()) {
+                    const CoolingDeviceStatus &status = name_status_pair.second;
+                    dump_buf << " Name: " << name_status_pair.first << " State: " << status.state
+                             << " Changes: " << status.change_count << " TimeInStateMs: [";
+                    for (const auto &time_in_state : status.time_in_state) {
+                        dump_buf << time_in_state.count() << " ";
+                    }
+                    dump_buf << "]" << std::endl;
+                }
+            }
+            // "--history" also dumps every record in the history window
+            dumpHistory(&dump_buf, args.size() == 1 && args[0] == "--history");
         }
         std::string buf = dump_buf.str();
         if (!android::base::WriteStringToFd(buf, fd)) {
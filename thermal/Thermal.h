@@ -17,6 +17,7 @@
 #define ANDROID_HARDWARE_THERMAL_V2_0_CROSSHATCH_THERMAL_H
 
 #include <mutex>
+#include <sstream>
 #include <thread>
 
 #include <android/hardware/thermal/2.0/IThermal.h>
@@ -81,6 +82,9 @@ class Thermal : public IThermal {
     void sendThermalChangedCallback(const std::vector<Temperature_2_0> &temps);
 
   private:
+    // Dump statistics of the sensor history, and every record if dump_records is set
+    void dumpHistory(std::ostringstream *dump_buf, bool dump_records);
+
     ThermalHelper thermal_helper_;
     std::mutex thermal_callback_mutex_;
     std::vector<CallbackSetting> callbacks_;
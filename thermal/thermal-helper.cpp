@@ -14,20 +14,28 @@
  * limitations under the License.
  */
 
+#define ATRACE_TAG (ATRACE_TAG_POWER | ATRACE_TAG_HAL)
+
+#include <algorithm>
+#include <charconv>
+#include <cinttypes>
 #include <iterator>
 #include <set>
-#include <sstream>
 #include <thread>
 #include <vector>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
+#include <android-base/parseint.h>
 #include <android-base/properties.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
+#include <android-base/unique_fd.h>
 #include <hidl/HidlTransportSupport.h>
+#include <utils/Trace.h>
 
 #include "thermal-helper.h"
+#include "utils/config_blob.h"
 
 namespace android {
 namespace hardware {
@@ -35,10 +43,9 @@ namespace thermal {
 namespace V2_0 {
 namespace implementation {
 
-constexpr std::string_view kCpuOnlineRoot("/sys/devices/system/cpu");
 constexpr std::string_view kThermalSensorsRoot("/sys/devices/virtual/thermal");
 constexpr std::string_view kCpuUsageFile("/proc/stat");
-constexpr std::string_view kCpuOnlineFileSuffix("online");
+constexpr std::string_view kCpuOnlineFile("/sys/devices/system/cpu/online");
 constexpr std::string_view kCpuPresentFile("/sys/devices/system/cpu/present");
 constexpr std::string_view kSensorPrefix("thermal_zone");
 constexpr std::string_view kCoolingDevicePrefix("cooling_device");
@@ -51,6 +58,8 @@ constexpr std::string_view kUserSpaceSuffix("user_space");
 constexpr std::string_view kCoolingDeviceCurStateSuffix("cur_state");
 constexpr std::string_view kConfigProperty("vendor.thermal.config");
 constexpr std::string_view kConfigDefaultFileName("thermal_info_config.json");
+constexpr std::string_view kSensorCacheBudgetProperty("vendor.thermal.sensor_cache_ms");
+constexpr uint32_t kSensorCacheBudgetDefaultMs = 1000;
 
 namespace {
 using android::base::StringPrintf;
@@ -85,56 +94,138 @@ std::size_t getNumberOfCores() {
 }
 const std::size_t kMaxCpus = getNumberOfCores();
 
+// Parse the unsigned integer at the beginning of str, skipping leading spaces, and advance str
+// past it. Return false if no integer is found.
+bool consumeUint(std::string_view *str, uint64_t *out) {
+    size_t start = str->find_first_not_of(' ');
+    if (start == std::string_view::npos) {
+        return false;
+    }
+    const char *begin = str->data() + start;
+    auto result = std::from_chars(begin, str->data() + str->size(), *out);
+    if (result.ec != std::errc()) {
+        return false;
+    }
+    str->remove_prefix(result.ptr - str->data());
+    return true;
+}
+
+/*
+ * The online file contains a comma separated list of cpu ranges, e.g. "0-3,5,7-8".
+ * Return the online state of each cpu number, or an empty vector on parse error.
+ */
+std::vector<bool> parseCpuOnlineList(std::string_view list) {
+    std::vector<bool> online(kMaxCpus, false);
+    while (!list.empty() && list.front() != '\n') {
+        uint64_t first, last;
+        if (!consumeUint(&list, &first)) {
+            return {};
+        }
+        last = first;
+        if (!list.empty() && list.front() == '-') {
+            list.remove_prefix(1);
+            if (!consumeUint(&list, &last)) {
+                return {};
+            }
+        }
+        for (uint64_t cpu = first; cpu <= last && cpu < kMaxCpus; ++cpu) {
+            online[cpu] = true;
+        }
+        if (!list.empty() && list.front() == ',') {
+            list.remove_prefix(1);
+        }
+    }
+    return online;
+}
+
+// Read the leading cpu lines of fd into buffer, stopping before the long interrupt counters.
+bool readCpuStat(int fd, std::string *buffer) {
+    constexpr size_t kReadChunkSize = 4096;
+    size_t size = 0;
+    while (true) {
+        if (buffer->size() < size + kReadChunkSize) {
+            buffer->resize(size + kReadChunkSize);
+        }
+        ssize_t n = TEMP_FAILURE_RETRY(read(fd, buffer->data() + size, kReadChunkSize));
+        if (n < 0) {
+            return false;
+        }
+        size += n;
+        if (n == 0 || std::string_view(buffer->data(), size).find("\nintr") !=
+                              std::string_view::npos) {
+            break;
+        }
+    }
+    buffer->resize(size);
+    return true;
+}
+
 void parseCpuUsagesFileAndAssignUsages(hidl_vec<CpuUsage> *cpu_usages) {
+    // Reused across calls to avoid reallocating the read buffer.
+    thread_local std::string data;
     uint64_t cpu_num, user, nice, system, idle;
-    std::string cpu_name;
-    std::string data;
-    if (!android::base::ReadFileToString(kCpuUsageFile.data(), &data)) {
+
+    std::string online_data;
+    if (!android::base::ReadFileToString(kCpuOnlineFile.data(), &online_data)) {
+        LOG(ERROR) << "Could not open Cpu online file: " << kCpuOnlineFile;
+        return;
+    }
+    std::vector<bool> cpu_online = parseCpuOnlineList(online_data);
+    if (cpu_online.empty()) {
+        LOG(ERROR) << "Error parsing Cpu online file content: " << online_data;
+        return;
+    }
+
+    android::base::unique_fd fd(
+            TEMP_FAILURE_RETRY(open(kCpuUsageFile.data(), O_RDONLY | O_CLOEXEC)));
+    if (fd < 0 || !readCpuStat(fd, &data)) {
         LOG(ERROR) << "Error reading Cpu usage file: " << kCpuUsageFile;
         return;
     }
 
-    std::istringstream stat_data(data);
-    std::string line;
-    while (std::getline(stat_data, line)) {
-        if (line.find("cpu") == 0 && isdigit(line[3])) {
-            // Split the string using spaces.
-            std::vector<std::string> words = android::base::Split(line, " ");
-            cpu_name = words[0];
-            cpu_num = std::stoi(cpu_name.substr(3));
-
-            if (cpu_num < kMaxCpus) {
-                user = std::stoi(words[1]);
-                nice = std::stoi(words[2]);
-                system = std::stoi(words[3]);
-                idle = std::stoi(words[4]);
-
-                // Check if the CPU is online by reading the online file.
-                std::string cpu_online_path =
-                        StringPrintf("%s/%s/%s", kCpuOnlineRoot.data(), cpu_name.c_str(),
-                                     kCpuOnlineFileSuffix.data());
-                std::string is_online;
-                if (!android::base::ReadFileToString(cpu_online_path, &is_online)) {
-                    LOG(ERROR) << "Could not open Cpu online file: " << cpu_online_path;
-                    return;
-                }
-                is_online = android::base::Trim(is_online);
+    // Offline cpus are not listed in /proc/stat.
+    for (cpu_num = 0; cpu_num < kMaxCpus; ++cpu_num) {
+        (*cpu_usages)[cpu_num].name = StringPrintf("cpu%" PRIu64, cpu_num);
+        (*cpu_usages)[cpu_num].isOnline = cpu_online[cpu_num];
+    }
 
-                (*cpu_usages)[cpu_num].name = cpu_name;
-                (*cpu_usages)[cpu_num].active = user + nice + system;
-                (*cpu_usages)[cpu_num].total = user + nice + system + idle;
-                (*cpu_usages)[cpu_num].isOnline = (is_online == "1") ? true : false;
-            } else {
-                LOG(ERROR) << "Unexpected cpu number: " << words[0];
-                return;
-            }
+    std::string_view stat_data(data);
+    while (!stat_data.empty()) {
+        size_t line_end = stat_data.find('\n');
+        std::string_view line = stat_data.substr(0, line_end);
+        stat_data.remove_prefix(line_end == std::string_view::npos ? stat_data.size()
+                                                                   : line_end + 1);
+        if (line.substr(0, 3) != "cpu") {
+            // cpu lines are at the beginning of the file
+            break;
+        }
+        const std::string_view cpu_line = line;
+        line.remove_prefix(3);
+        if (line.empty() || !isdigit(line[0])) {
+            continue;
+        }
+
+        if (!consumeUint(&line, &cpu_num) || !consumeUint(&line, &user) ||
+            !consumeUint(&line, &nice) || !consumeUint(&line, &system) ||
+            !consumeUint(&line, &idle)) {
+            LOG(ERROR) << "Unexpected cpu line: " << cpu_line;
+            return;
+        }
+
+        if (cpu_num < kMaxCpus) {
+            (*cpu_usages)[cpu_num].active = user + nice + system;
+            (*cpu_usages)[cpu_num].total = user + nice + system + idle;
+        } else {
+            LOG(ERROR) << "Unexpected cpu number: " << cpu_num;
+            return;
         }
     }
 }
 
-std::map<std::string, std::string> parseThermalPathMap(std::string_view prefix) {
+std::map<std::string, std::string> parseThermalPathMap(std::string_view thermal_root,
+                                                       std::string_view prefix) {
     std::map<std::string, std::string> path_map;
-    std::unique_ptr<DIR, int (*)(DIR *)> dir(opendir(kThermalSensorsRoot.data()), closedir);
+    std::unique_ptr<DIR, int (*)(DIR *)> dir(opendir(thermal_root.data()), closedir);
     if (!dir) {
         return path_map;
     }
@@ -150,7 +241,7 @@ std::map<std::string, std::string> parseThermalPathMap(std::string_view prefix)
             continue;
         }
 
-        std::string path = android::base::StringPrintf("%s/%s/%s", kThermalSensorsRoot.data(),
+        std::string path = android::base::StringPrintf("%s/%s/%s", thermal_root.data(),
                                                        dp->d_name, kThermalNameFile.data());
         std::string name;
         if (!android::base::ReadFileToString(path, &name)) {
@@ -160,66 +251,158 @@ std::map<std::string, std::string> parseThermalPathMap(std::string_view prefix)
 
         path_map.emplace(
                 android::base::Trim(name),
-                android::base::StringPrintf("%s/%s", kThermalSensorsRoot.data(), dp->d_name));
+                android::base::StringPrintf("%s/%s", thermal_root.data(), dp->d_name));
     }
 
     return path_map;
 }
 
+std::shared_ptr<const ThermalConfig> parseThermalConfig(std::string_view config_path) {
+    auto config = std::make_shared<ThermalConfig>();
+    ParseThermalConfig(config_path, &config->sensor_info_map, &config->cooling_device_info_map);
+    return config;
+}
+
+// Split a power budget across the cooling devices of pid_info like the kernel power allocator
+// governor: in proportion to weight * demand, the demand being the state 0 power scaled by the
+// device load. Grants above the state 0 power are capped and the excess is redistributed to the
+// devices with headroom.
+std::vector<float> allocatePowerBudget(const PIDInfo &pid_info, float budget,
+                                       const std::map<std::string, float> &cdev_loads,
+                                       const std::map<std::string, CdevInfo> &cdev_info_map) {
+    const size_t num_cdevs = pid_info.cdev_request.size();
+    std::vector<float> max_power(num_cdevs);
+    std::vector<float> weighted_demand(num_cdevs);
+    float total_weighted_demand = 0.0;
+    float total_weight = 0.0;
+    for (size_t i = 0; i < num_cdevs; ++i) {
+        const std::string &cdev_name = pid_info.cdev_request[i];
+        const auto it = cdev_loads.find(cdev_name);
+        const float load = it != cdev_loads.end() ? it->second : 1.0;
+        max_power[i] = cdev_info_map.at(cdev_name).state2power[0];
+        weighted_demand[i] = pid_info.cdev_weight[i] * max_power[i] * load;
+        total_weighted_demand += weighted_demand[i];
+        total_weight += pid_info.cdev_weight[i];
+    }
+
+    std::vector<float> granted(num_cdevs);
+    std::vector<float> headroom(num_cdevs, 0.0);
+    float excess = 0.0;
+    float total_headroom = 0.0;
+    for (size_t i = 0; i < num_cdevs; ++i) {
+        if (total_weighted_demand > 0) {
+            granted[i] = budget * weighted_demand[i] / total_weighted_demand;
+        } else if (total_weight > 0) {
+            // All idle, fall back to the weights
+            granted[i] = budget * pid_info.cdev_weight[i] / total_weight;
+        } else {
+            granted[i] = budget / num_cdevs;
+        }
+        if (granted[i] > max_power[i]) {
+            excess += granted[i] - max_power[i];
+            granted[i] = max_power[i];
+        } else {
+            headroom[i] = max_power[i] - granted[i];
+            total_headroom += headroom[i];
+        }
+    }
+    if (excess > 0 && total_headroom > 0) {
+        for (size_t i = 0; i < num_cdevs; ++i) {
+            granted[i] += std::min(excess, total_headroom) * headroom[i] / total_headroom;
+        }
+    }
+    return granted;
+}
+
+PIDStatus initialPIDStatus(NotificationTime now) {
+    return {
+            .i_budget = 0.0,
+            .prev_err = NAN,
+            .budget = NAN,
+            .last_update = now,
+    };
+}
+
 }  // namespace
 
+ThermalHelper::ThermalHelper(const NotificationCallback &cb)
+    : ThermalHelper(cb, {
+              .config_path = "/vendor/etc/" + android::base::GetProperty(
+                                                      kConfigProperty.data(),
+                                                      kConfigDefaultFileName.data()),
+              .thermal_root = std::string(kThermalSensorsRoot),
+              .clock = [] { return std::chrono::steady_clock::now(); },
+              .start_watcher = true,
+      }) {}
+
 /*
  * Populate the sensor_name_to_file_map_ map by walking through the file tree,
  * reading the type file and assigning the temp file path to the map.  If we do
  * not succeed, abort.
  */
-ThermalHelper::ThermalHelper(const NotificationCallback &cb)
+ThermalHelper::ThermalHelper(const NotificationCallback &cb, const ThermalHelperOptions &options)
     : thermal_watcher_(new ThermalWatcher(
-              std::bind(&ThermalHelper::thermalWatcherCallbackFunc, this, std::placeholders::_1))),
+              std::bind(&ThermalHelper::thermalWatcherCallbackFunc, this, std::placeholders::_1),
+              std::bind(&ThermalHelper::cdevWatcherCallbackFunc, this, std::placeholders::_1))),
       cb_(cb),
-      cooling_device_info_map_(ParseCoolingDevice(
-              "/vendor/etc/" +
-              android::base::GetProperty(kConfigProperty.data(), kConfigDefaultFileName.data()))),
-      sensor_info_map_(ParseSensorInfo(
-              "/vendor/etc/" +
-              android::base::GetProperty(kConfigProperty.data(), kConfigDefaultFileName.data()))) {
-    for (auto const &name_status_pair : sensor_info_map_) {
+      config_path_(options.config_path),
+      thermal_root_(options.thermal_root),
+      clock_(options.clock),
+      config_(parseThermalConfig(config_path_)),
+      sensor_cache_budget_(android::base::GetUintProperty<uint32_t>(
+              kSensorCacheBudgetProperty.data(), kSensorCacheBudgetDefaultMs)) {
+    for (auto const &name_status_pair : config_->sensor_info_map) {
         sensor_status_map_[name_status_pair.first] = {
             .severity = ThrottlingSeverity::NONE,
             .prev_hot_severity = ThrottlingSeverity::NONE,
             .prev_cold_severity = ThrottlingSeverity::NONE,
+            .last_notification_time = clock_(),
+            .notification_pending = false,
+            .notification_count = 0,
+            .suppressed_notification_count = 0,
         };
+        pid_status_map_[name_status_pair.first] = initialPIDStatus(clock_());
+        if (name_status_pair.second.is_monitor) {
+            sensor_history_map_[name_status_pair.first];
+            SensorTraceNames &trace_names = sensor_trace_names_[name_status_pair.first];
+            trace_names.temperature = "thermal:" + name_status_pair.first + ":temp";
+            trace_names.severity = "thermal:" + name_status_pair.first + ":severity";
+            for (size_t i = 0; i < kThrottlingSeverityCount; ++i) {
+                trace_names.notification[i] = "thermal:notify " + name_status_pair.first + " " +
+                                              toString(static_cast<ThrottlingSeverity>(i));
+            }
+        }
     }
 
-    auto tz_map = parseThermalPathMap(kSensorPrefix.data());
-    auto cdev_map = parseThermalPathMap(kCoolingDevicePrefix.data());
+    tz_map_ = parseThermalPathMap(thermal_root_, kSensorPrefix);
+    auto cdev_map = parseThermalPathMap(thermal_root_, kCoolingDevicePrefix);
 
-    is_initialized_ = initializeSensorMap(tz_map) && initializeCoolingDevices(cdev_map);
+    is_initialized_ = initializeSensorMap(tz_map_) && initializeCoolingDevices(cdev_map) &&
+                      initializePID();
     if (!is_initialized_) {
         LOG(FATAL) << "ThermalHAL could not be initialized properly.";
     }
-    std::set<std::string> cdev_paths;
-    std::transform(cooling_device_info_map_.cbegin(), cooling_device_info_map_.cend(),
-                   std::inserter(cdev_paths, cdev_paths.begin()),
-                   [this](std::pair<std::string, const CoolingType> const &cdev) {
-                       std::string path =
-                               cooling_devices_.getThermalFilePath(std::string_view(cdev.first));
-                       if (!path.empty())
-                           return path;
-                       else
-                           return std::string();
-                   });
+    refreshCoolingDeviceStatus(false);
+    std::map<std::string, std::string> cdev_paths;
+    for (const auto &name_info_pair : config_->cooling_device_info_map) {
+        cdev_paths.emplace(name_info_pair.first,
+                           cooling_devices_.getThermalFilePath(name_info_pair.first));
+    }
     std::set<std::string> monitored_sensors;
-    std::transform(sensor_info_map_.cbegin(), sensor_info_map_.cend(),
+    std::transform(config_->sensor_info_map.cbegin(), config_->sensor_info_map.cend(),
                    std::inserter(monitored_sensors, monitored_sensors.begin()),
-                   [](std::pair<std::string, SensorInfo> const &sensor) {
+                   [](const auto &sensor) {
                        if (sensor.second.is_monitor)
                            return sensor.first;
                        else
                            return std::string();
                    });
 
-    thermal_watcher_->registerFilesToWatch(monitored_sensors, cdev_paths, initializeTrip(tz_map));
+    uevent_monitor_ = initializeTrip(tz_map_, config_->sensor_info_map);
+    if (!options.start_watcher) {
+        return;
+    }
+    thermal_watcher_->registerFilesToWatch(monitored_sensors, cdev_paths, uevent_monitor_);
 
     // Need start watching after status map initialized
     is_initialized_ = thermal_watcher_->startWatchingDeviceFiles();
@@ -238,16 +421,134 @@ bool ThermalHelper::readCoolingDevice(std::string_view cooling_device,
         return false;
     }
 
-    const CoolingType &type = cooling_device_info_map_.at(cooling_device.data());
-
-    out->type = type;
+    const auto config = GetConfig();
+    out->type = config->cooling_device_info_map.at(cooling_device.data()).type;
     out->name = cooling_device.data();
     out->value = std::stoi(data);
+    updateCoolingDeviceStatus(cooling_device, out->value, clock_());
 
     return true;
 }
 
-bool ThermalHelper::readTemperature(std::string_view sensor_name, Temperature_1_0 *out) const {
+void ThermalHelper::updateCoolingDeviceStatus(std::string_view cooling_device, size_t state,
+                                              NotificationTime now) const {
+    // writer lock
+    std::unique_lock<std::shared_mutex> _lock(cooling_device_status_map_mutex_);
+    auto it = cooling_device_status_map_.find(cooling_device.data());
+    if (it == cooling_device_status_map_.end()) {
+        cooling_device_status_map_[cooling_device.data()] = {
+                .state = state,
+                .last_change = now,
+                .time_in_state = {},
+                .change_count = 0,
+        };
+        return;
+    }
+    CoolingDeviceStatus &status = it->second;
+    if (state == status.state) {
+        return;
+    }
+    if (status.time_in_state.size() <= status.state) {
+        status.time_in_state.resize(status.state + 1);
+    }
+    status.time_in_state[status.state] +=
+            std::chrono::duration_cast<std::chrono::milliseconds>(now - status.last_change);
+    status.state = state;
+    status.last_change = now;
+    ++status.change_count;
+}
+
+void ThermalHelper::refreshCoolingDeviceStatus(bool skip_notifying) const {
+    const auto config = GetConfig();
+    const auto now = clock_();
+    for (const auto &name_info_pair : config->cooling_device_info_map) {
+        if (skip_notifying && notifying_cdevs_.count(name_info_pair.first)) {
+            continue;
+        }
+        std::string data;
+        size_t state;
+        if (!cooling_devices_.readThermalFile(name_info_pair.first, &data) ||
+            !android::base::ParseUint(data, &state)) {
+            LOG(ERROR) << "Failed to read cooling device " << name_info_pair.first;
+            continue;
+        }
+        updateCoolingDeviceStatus(name_info_pair.first, state, now);
+    }
+}
+
+std::map<std::string, CoolingDeviceStatus> ThermalHelper::GetCoolingDeviceStatusMap() const {
+    const auto now = clock_();
+    std::map<std::string, CoolingDeviceStatus> status_map;
+    {
+        // reader lock
+        std::shared_lock<std::shared_mutex> _lock(cooling_device_status_map_mutex_);
+        status_map = cooling_device_status_map_;
+    }
+    // Account the time spent in the current state so far.
+    for (auto &name_status_pair : status_map) {
+        CoolingDeviceStatus &status = name_status_pair.second;
+        if (status.time_in_state.size() <= status.state) {
+            status.time_in_state.resize(status.state + 1);
+        }
+        status.time_in_state[status.state] +=
+                std::chrono::duration_cast<std::chrono::milliseconds>(now - status.last_change);
+        status.last_change = now;
+    }
+    return status_map;
+}
+
+void ThermalHelper::cdevWatcherCallbackFunc(
+        const std::map<std::string, std::string> &cdev_states) {
+    const auto now = clock_();
+    for (const auto &name_state_pair : cdev_states) {
+        size_t state;
+        if (!android::base::ParseUint(name_state_pair.second, &state)) {
+            LOG(ERROR) << "Invalid cooling device " << name_state_pair.first
+                       << " state: " << name_state_pair.second;
+            continue;
+        }
+        notifying_cdevs_.insert(name_state_pair.first);
+        updateCoolingDeviceStatus(name_state_pair.first, state, now);
+    }
+}
+
+bool ThermalHelper::readSensorValue(std::string_view sensor_name, float *value,
+                                    bool force_sysfs) const {
+    const auto config = GetConfig();
+    const SensorInfo &sensor_info = config->sensor_info_map.at(sensor_name.data());
+    // Virtual sensors are cheap to compute and always reflect their cached linked sensors.
+    if (sensor_info.virtual_sensor_info != nullptr) {
+        return computeVirtualSensorValue(sensor_name, *sensor_info.virtual_sensor_info, value);
+    }
+
+    const auto now = clock_();
+    if (!force_sysfs && sensor_cache_budget_.count() > 0) {
+        // reader lock, cache is shared by Binder calls and the watcher thread.
+        std::shared_lock<std::shared_mutex> _lock(sensor_cache_map_mutex_);
+        auto cache_itr = sensor_cache_map_.find(sensor_name.data());
+        if (cache_itr != sensor_cache_map_.end() &&
+            now - cache_itr->second.read_time <= sensor_cache_budget_) {
+            *value = cache_itr->second.value;
+            return true;
+        }
+    }
+
+    if (!readSensorFile(sensor_name, sensor_info, value)) {
+        return false;
+    }
+    {
+        // writer lock
+        std::unique_lock<std::shared_mutex> _lock(sensor_cache_map_mutex_);
+        sensor_cache_map_[sensor_name.data()] = {
+                .value = *value,
+                .read_time = now,
+        };
+    }
+    return true;
+}
+
+bool ThermalHelper::readSensorFile(std::string_view sensor_name, const SensorInfo &sensor_info,
+                                   float *value) const {
     // Read the file.  If the file can't be read temp will be empty string.
     std::string temp;
 
@@ -261,14 +562,116 @@ bool ThermalHelper::readTemperature(std::string_view sensor_name, Temperature_1_
         return false;
     }
 
-    const SensorInfo &sensor_info = sensor_info_map_.at(sensor_name.data());
+    *value = std::stof(temp) * sensor_info.multiplier;
+    return true;
+}
+
+void ThermalHelper::prefetchSensorValues(const std::vector<std::string_view> &sensor_names,
+                                         bool force_sysfs) const {
+    // Without the cache every read goes to sysfs anyway.
+    if (sensor_cache_budget_.count() == 0) {
+        return;
+    }
+    const auto config = GetConfig();
+    const auto now = clock_();
+
+    // Expand virtual sensors to the physical sensors they are computed from.
+    std::set<std::string_view> physical_sensors;
+    std::vector<std::string_view> pending_sensors(sensor_names);
+    while (!pending_sensors.empty()) {
+        const std::string_view sensor_name = pending_sensors.back();
+        pending_sensors.pop_back();
+        const SensorInfo &sensor_info = config->sensor_info_map.at(sensor_name.data());
+        if (sensor_info.virtual_sensor_info == nullptr) {
+            physical_sensors.insert(sensor_name);
+            continue;
+        }
+        for (const auto &linked_sensor : sensor_info.virtual_sensor_info->linked_sensors) {
+            pending_sensors.emplace_back(linked_sensor);
+        }
+    }
+
+    if (!force_sysfs) {
+        // reader lock
+        std::shared_lock<std::shared_mutex> _lock(sensor_cache_map_mutex_);
+        for (auto it = physical_sensors.begin(); it != physical_sensors.end();) {
+            auto cache_itr = sensor_cache_map_.find(it->data());
+            if (cache_itr != sensor_cache_map_.end() &&
+                now - cache_itr->second.read_time <= sensor_cache_budget_) {
+                it = physical_sensors.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    std::vector<std::pair<std::string_view, float>> values;
+    values.reserve(physical_sensors.size());
+    for (const auto &sensor_name : physical_sensors) {
+        float value;
+        if (readSensorFile(sensor_name, config->sensor_info_map.at(sensor_name.data()), &value)) {
+            values.emplace_back(sensor_name, value);
+        }
+    }
+    {
+        // writer lock, taken once for the whole batch.
+        std::unique_lock<std::shared_mutex> _lock(sensor_cache_map_mutex_);
+        for (const auto &name_value_pair : values) {
+            sensor_cache_map_[name_value_pair.first.data()] = {
+                    .value = name_value_pair.second,
+                    .read_time = now,
+            };
+        }
+    }
+}
+
+bool ThermalHelper::computeVirtualSensorValue(std::string_view sensor_name,
+                                              const VirtualSensorInfo &virtual_sensor_info,
+                                              float *value) const {
+    float result = NAN;
+    for (size_t i = 0; i < virtual_sensor_info.linked_sensors.size(); ++i) {
+        float linked_value;
+        // Linked sensors go through the cache, so sensors already read in this watcher pass are
+        // not read from sysfs again.
+        if (!readSensorValue(virtual_sensor_info.linked_sensors[i], &linked_value, false)) {
+            LOG(ERROR) << sensor_name << ": failed to read linked sensor "
+                       << virtual_sensor_info.linked_sensors[i];
+            return false;
+        }
+        linked_value *= virtual_sensor_info.coefficients[i];
+
+        switch (virtual_sensor_info.formula) {
+            case FormulaOption::WEIGHTED_SUM:
+                result = std::isnan(result) ? linked_value : result + linked_value;
+                break;
+            case FormulaOption::MAXIMUM:
+                result = std::isnan(result) ? linked_value : std::max(result, linked_value);
+                break;
+            case FormulaOption::MINIMUM:
+                result = std::isnan(result) ? linked_value : std::min(result, linked_value);
+                break;
+        }
+    }
+    *value = result + virtual_sensor_info.offset;
+    return true;
+}
+
+bool ThermalHelper::readTemperature(std::string_view sensor_name, Temperature_1_0 *out) const {
+    float value;
+
+    if (!readSensorValue(sensor_name, &value, false)) {
+        return false;
+    }
+
+    const auto config = GetConfig();
+    const SensorInfo &sensor_info = config->sensor_info_map.at(sensor_name.data());
     TemperatureType_1_0 type =
         (static_cast<int>(sensor_info.type) > static_cast<int>(TemperatureType_1_0::SKIN))
             ? TemperatureType_1_0::UNKNOWN
             : static_cast<TemperatureType_1_0>(sensor_info.type);
     out->type = type;
     out->name = sensor_name.data();
-    out->currentValue = std::stof(temp) * sensor_info.multiplier;
+    out->currentValue = value;
     out->throttlingThreshold =
         sensor_info.hot_thresholds[static_cast<size_t>(ThrottlingSeverity::SEVERE)];
     out->shutdownThreshold =
@@ -280,24 +683,19 @@ bool ThermalHelper::readTemperature(std::string_view sensor_name, Temperature_1_
 
 bool ThermalHelper::readTemperature(
         std::string_view sensor_name, Temperature_2_0 *out,
-        std::pair<ThrottlingSeverity, ThrottlingSeverity> *throtting_status) const {
-    // Read the file.  If the file can't be read temp will be empty string.
-    std::string temp;
+        std::pair<ThrottlingSeverity, ThrottlingSeverity> *throtting_status,
+        bool force_sysfs) const {
+    float value;
 
-    if (!thermal_sensors_.readThermalFile(sensor_name, &temp)) {
-        LOG(ERROR) << "readTemperature: sensor not found: " << sensor_name;
+    if (!readSensorValue(sensor_name, &value, force_sysfs)) {
         return false;
     }
 
-    if (temp.empty()) {
-        LOG(ERROR) << "readTemperature: failed to read sensor: " << sensor_name;
-        return false;
-    }
-
-    const auto &sensor_info = sensor_info_map_.at(sensor_name.data());
+    const auto config = GetConfig();
+    const auto &sensor_info = config->sensor_info_map.at(sensor_name.data());
     out->type = sensor_info.type;
     out->name = sensor_name.data();
-    out->value = std::stof(temp) * sensor_info.multiplier;
+    out->value = value;
 
     std::pair<ThrottlingSeverity, ThrottlingSeverity> status =
         std::make_pair(ThrottlingSeverity::NONE, ThrottlingSeverity::NONE);
@@ -331,12 +729,13 @@ bool ThermalHelper::readTemperatureThreshold(std::string_view sensor_name,
     std::string temp;
     std::string path;
 
-    if (!sensor_info_map_.count(sensor_name.data())) {
+    const auto config = GetConfig();
+    if (!config->sensor_info_map.count(sensor_name.data())) {
         LOG(ERROR) << __func__ << ": sensor not found: " << sensor_name;
         return false;
     }
 
-    const auto &sensor_info = sensor_info_map_.at(sensor_name.data());
+    const auto &sensor_info = config->sensor_info_map.at(sensor_name.data());
 
     out->type = sensor_info.type;
     out->name = sensor_name.data();
@@ -388,8 +787,14 @@ std::pair<ThrottlingSeverity, ThrottlingSeverity> ThermalHelper::getSeverityFrom
 }
 
 bool ThermalHelper::initializeSensorMap(const std::map<std::string, std::string> &path_map) {
-    for (const auto &sensor_info_pair : sensor_info_map_) {
+    size_t num_virtual_sensors = 0;
+    for (const auto &sensor_info_pair : config_->sensor_info_map) {
         std::string_view sensor_name = sensor_info_pair.first;
+        // Virtual sensors are computed from linked sensors and have no sysfs node
+        if (sensor_info_pair.second.virtual_sensor_info != nullptr) {
+            ++num_virtual_sensors;
+            continue;
+        }
         if (!path_map.count(sensor_name.data())) {
             LOG(ERROR) << "Could not find " << sensor_name << " in sysfs";
             continue;
@@ -400,14 +805,15 @@ bool ThermalHelper::initializeSensorMap(const std::map<std::string, std::string>
             LOG(ERROR) << "Could not add " << sensor_name << "to sensors map";
         }
     }
-    if (sensor_info_map_.size() == thermal_sensors_.getNumThermalFiles()) {
+    if (config_->sensor_info_map.size() ==
+        thermal_sensors_.getNumThermalFiles() + num_virtual_sensors) {
         return true;
     }
     return false;
 }
 
 bool ThermalHelper::initializeCoolingDevices(const std::map<std::string, std::string> &path_map) {
-    for (const auto &cooling_device_info_pair : cooling_device_info_map_) {
+    for (const auto &cooling_device_info_pair : config_->cooling_device_info_map) {
         std::string_view cooling_device_name = cooling_device_info_pair.first;
         if (!path_map.count(cooling_device_name.data())) {
             LOG(ERROR) << "Could not find " << cooling_device_name << " in sysfs";
@@ -420,18 +826,36 @@ bool ThermalHelper::initializeCoolingDevices(const std::map<std::string, std::st
             LOG(ERROR) << "Could not add " << cooling_device_name << "to cooling device map";
             continue;
         }
+        const std::string &load_path = cooling_device_info_pair.second.load_path;
+        if (!load_path.empty() &&
+            !cooling_device_loads_.addThermalFile(cooling_device_name, load_path)) {
+            LOG(ERROR) << "Could not add " << cooling_device_name << " load " << load_path;
+            return false;
+        }
     }
 
-    if (cooling_device_info_map_.size() == cooling_devices_.getNumThermalFiles()) {
+    if (config_->cooling_device_info_map.size() == cooling_devices_.getNumThermalFiles()) {
         return true;
     }
     return false;
 }
 
-bool ThermalHelper::initializeTrip(const std::map<std::string, std::string> &path_map) {
-    for (const auto &sensor_info : sensor_info_map_) {
+bool ThermalHelper::initializeTrip(const std::map<std::string, std::string> &path_map,
+                                   const std::map<std::string, SensorInfo> &sensor_info_map) {
+    for (const auto &sensor_info : sensor_info_map) {
+        std::string_view sensor_name = sensor_info.first;
+        // Virtual sensors never trigger uevent, fall back to polling when one is monitored. The
+        // unmonitored ones are only computed when read through the HAL.
+        if (sensor_info.second.virtual_sensor_info != nullptr && sensor_info.second.is_monitor) {
+            LOG(INFO) << sensor_name << " is a virtual sensor, uevent notify not supported";
+            return false;
+        }
+        // PID controller needs to run on every polling interval, monitored or not
+        if (sensor_info.second.pid_info != nullptr) {
+            LOG(INFO) << sensor_name << " is PID controlled, uevent notify not supported";
+            return false;
+        }
         if (sensor_info.second.is_monitor) {
-            std::string_view sensor_name = sensor_info.first;
             std::string_view tz_path = path_map.at(sensor_name.data());
             std::string tz_policy;
             std::string path = android::base::StringPrintf("%s/%s", (tz_path.data()),
@@ -481,10 +905,150 @@ bool ThermalHelper::initializeTrip(const std::map<std::string, std::string> &pat
     }
     return true;
 }
+bool ThermalHelper::initializePID() {
+    if (!ValidatePIDCoolingDevices(config_->sensor_info_map, config_->cooling_device_info_map)) {
+        return false;
+    }
+    for (const auto &sensor_info : config_->sensor_info_map) {
+        if (sensor_info.second.pid_info == nullptr) {
+            continue;
+        }
+        for (const auto &cdev_name : sensor_info.second.pid_info->cdev_request) {
+            cdev_status_map_[cdev_name] = 0;
+        }
+    }
+    return true;
+}
+
+bool ThermalHelper::reloadConfig(std::string_view config_path) {
+    std::lock_guard<std::mutex> _lock(config_reload_mutex_);
+    const std::string path = config_path.empty() ? config_path_ : std::string(config_path);
+    LOG(INFO) << "Reloading thermal config from " << path;
+
+    std::shared_ptr<const ThermalConfig> new_config = parseThermalConfig(path);
+    if (!validateConfig(*new_config)) {
+        LOG(ERROR) << "Rejected thermal config " << path;
+        return false;
+    }
+    // The thresholds of monitored sensors are also programmed as thermal zone trip points.
+    if (uevent_monitor_ && !initializeTrip(tz_map_, new_config->sensor_info_map)) {
+        LOG(ERROR) << "Failed to update trip points, rejected thermal config " << path;
+        initializeTrip(tz_map_, GetConfig()->sensor_info_map);
+        return false;
+    }
+
+    std::atomic_store(&pending_config_, std::move(new_config));
+    thermal_watcher_->wake();
+    return true;
+}
+
+bool ThermalHelper::validateConfig(const ThermalConfig &new_config) {
+    const auto config = GetConfig();
+    if (new_config.sensor_info_map.size() != config->sensor_info_map.size() ||
+        new_config.cooling_device_info_map.size() != config->cooling_device_info_map.size()) {
+        LOG(ERROR) << "Sensors or cooling devices cannot be added or removed on reload";
+        return false;
+    }
+    for (const auto &name_info_pair : new_config.sensor_info_map) {
+        const auto it = config->sensor_info_map.find(name_info_pair.first);
+        if (it == config->sensor_info_map.end()) {
+            LOG(ERROR) << "Unknown sensor " << name_info_pair.first;
+            return false;
+        }
+        if (name_info_pair.second.is_monitor != it->second.is_monitor) {
+            LOG(ERROR) << name_info_pair.first << ": Monitor cannot be changed on reload";
+            return false;
+        }
+        if (name_info_pair.second.virtual_sensor_info == nullptr &&
+            thermal_sensors_.getThermalFilePath(name_info_pair.first).empty()) {
+            LOG(ERROR) << name_info_pair.first << " has no sysfs node";
+            return false;
+        }
+    }
+    for (const auto &name_info_pair : new_config.cooling_device_info_map) {
+        const auto it = config->cooling_device_info_map.find(name_info_pair.first);
+        if (it == config->cooling_device_info_map.end()) {
+            LOG(ERROR) << "Unknown cooling device " << name_info_pair.first;
+            return false;
+        }
+        if (name_info_pair.second.load_path != it->second.load_path) {
+            LOG(ERROR) << name_info_pair.first << ": LoadPath cannot be changed on reload";
+            return false;
+        }
+    }
+    return ValidatePIDCoolingDevices(new_config.sensor_info_map,
+                                     new_config.cooling_device_info_map);
+}
+
+void ThermalHelper::applyPendingConfig() {
+    std::shared_ptr<const ThermalConfig> new_config =
+            std::atomic_exchange(&pending_config_, std::shared_ptr<const ThermalConfig>());
+    if (new_config == nullptr) {
+        return;
+    }
+    const auto config = GetConfig();
+    {
+        // writer lock
+        std::unique_lock<std::shared_mutex> _lock(sensor_status_map_mutex_);
+        for (auto &name_status_pair : sensor_status_map_) {
+            if (SerializeSensorInfo(config->sensor_info_map.at(name_status_pair.first)) ==
+                SerializeSensorInfo(new_config->sensor_info_map.at(name_status_pair.first))) {
+                continue;
+            }
+            // Keep the reported severity, so listeners are only notified if the new thresholds
+            // change it, but drop the hysteresis and PID state tied to the old config.
+            SensorStatus &sensor_status = name_status_pair.second;
+            sensor_status.prev_hot_severity = ThrottlingSeverity::NONE;
+            sensor_status.prev_cold_severity = ThrottlingSeverity::NONE;
+            pid_status_map_.at(name_status_pair.first) = initialPIDStatus(clock_());
+            LOG(INFO) << name_status_pair.first << " config changed, sensor status reset";
+        }
+        std::atomic_store(&config_, new_config);
+    }
+    {
+        // Cached readings may be scaled with the old multiplier or formula.
+        std::unique_lock<std::shared_mutex> _lock(sensor_cache_map_mutex_);
+        sensor_cache_map_.clear();
+    }
+
+    // Keep the state of cooling devices still controlled by PID, release the others.
+    std::map<std::string, size_t> cdev_status_map;
+    for (const auto &name_info_pair : new_config->sensor_info_map) {
+        if (name_info_pair.second.pid_info == nullptr) {
+            continue;
+        }
+        for (const auto &cdev_name : name_info_pair.second.pid_info->cdev_request) {
+            const auto it = cdev_status_map_.find(cdev_name);
+            cdev_status_map[cdev_name] = it != cdev_status_map_.end() ? it->second : 0;
+        }
+    }
+    for (const auto &name_state_pair : cdev_status_map_) {
+        if (!cdev_status_map.count(name_state_pair.first) && name_state_pair.second != 0 &&
+            !cooling_devices_.writeThermalFile(name_state_pair.first, "0")) {
+            LOG(ERROR) << "Failed to release cooling device " << name_state_pair.first;
+        }
+    }
+    cdev_status_map_ = std::move(cdev_status_map);
+    LOG(INFO) << "Thermal config reloaded";
+}
+
+std::map<std::string, SensorStatus> ThermalHelper::GetSensorStatusMap() const {
+    // reader lock
+    std::shared_lock<std::shared_mutex> _lock(sensor_status_map_mutex_);
+    return sensor_status_map_;
+}
+
 bool ThermalHelper::fillTemperatures(hidl_vec<Temperature_1_0> *temperatures) const {
-    temperatures->resize(sensor_info_map_.size());
+    const auto config = GetConfig();
+    std::vector<std::string_view> sensor_names;
+    for (const auto &name_info_pair : config->sensor_info_map) {
+        sensor_names.emplace_back(name_info_pair.first);
+    }
+    prefetchSensorValues(sensor_names, false);
+
+    temperatures->resize(config->sensor_info_map.size());
     int current_index = 0;
-    for (const auto &name_info_pair : sensor_info_map_) {
+    for (const auto &name_info_pair : config->sensor_info_map) {
         Temperature_1_0 temp;
 
         if (readTemperature(name_info_pair.first, &temp)) {
@@ -502,7 +1066,16 @@ bool ThermalHelper::fillTemperatures(hidl_vec<Temperature_1_0> *temperatures) co
 bool ThermalHelper::fillCurrentTemperatures(bool filterType, TemperatureType_2_0 type,
                                             hidl_vec<Temperature_2_0> *temperatures) const {
     std::vector<Temperature_2_0> ret;
-    for (const auto &name_info_pair : sensor_info_map_) {
+    const auto config = GetConfig();
+    std::vector<std::string_view> sensor_names;
+    for (const auto &name_info_pair : config->sensor_info_map) {
+        if (!filterType || name_info_pair.second.type == type) {
+            sensor_names.emplace_back(name_info_pair.first);
+        }
+    }
+    prefetchSensorValues(sensor_names, false);
+
+    for (const auto &name_info_pair : config->sensor_info_map) {
         Temperature_2_0 temp;
         if (filterType && name_info_pair.second.type != type) {
             continue;
@@ -522,7 +1095,8 @@ bool ThermalHelper::fillCurrentTemperatures(bool filterType, TemperatureType_2_0
 bool ThermalHelper::fillTemperatureThresholds(bool filterType, TemperatureType_2_0 type,
                                               hidl_vec<TemperatureThreshold> *thresholds) const {
     std::vector<TemperatureThreshold> ret;
-    for (const auto &name_info_pair : sensor_info_map_) {
+    const auto config = GetConfig();
+    for (const auto &name_info_pair : config->sensor_info_map) {
         TemperatureThreshold temp;
         if (filterType && name_info_pair.second.type != type) {
             continue;
@@ -542,15 +1116,34 @@ bool ThermalHelper::fillTemperatureThresholds(bool filterType, TemperatureType_2
 bool ThermalHelper::fillCurrentCoolingDevices(bool filterType, CoolingType type,
                                               hidl_vec<CoolingDevice_2_0> *cooling_devices) const {
     std::vector<CoolingDevice_2_0> ret;
-    for (const auto &name_info_pair : cooling_device_info_map_) {
-        CoolingDevice_2_0 value;
-        if (filterType && name_info_pair.second != type) {
-            continue;
+    std::vector<std::string_view> unknown_cdevs;
+    const auto config = GetConfig();
+    {
+        // reader lock, the watcher thread keeps the states up to date.
+        std::shared_lock<std::shared_mutex> _lock(cooling_device_status_map_mutex_);
+        for (const auto &name_info_pair : config->cooling_device_info_map) {
+            if (filterType && name_info_pair.second.type != type) {
+                continue;
+            }
+            auto status_itr = cooling_device_status_map_.find(name_info_pair.first);
+            if (status_itr == cooling_device_status_map_.end()) {
+                unknown_cdevs.emplace_back(name_info_pair.first);
+                continue;
+            }
+            ret.emplace_back(CoolingDevice_2_0{
+                    .type = name_info_pair.second.type,
+                    .name = name_info_pair.first,
+                    .value = status_itr->second.state,
+            });
         }
-        if (readCoolingDevice(name_info_pair.first, &value)) {
+    }
+    // Devices which could not be read so far
+    for (const auto &cooling_device : unknown_cdevs) {
+        CoolingDevice_2_0 value;
+        if (readCoolingDevice(cooling_device, &value)) {
             ret.emplace_back(std::move(value));
         } else {
-            LOG(ERROR) << __func__ << ": error reading cooling device: " << name_info_pair.first;
+            LOG(ERROR) << __func__ << ": error reading cooling device: " << cooling_device;
             return false;
         }
     }
@@ -564,23 +1157,171 @@ bool ThermalHelper::fillCpuUsages(hidl_vec<CpuUsage> *cpu_usages) const {
     return true;
 }
 
+float ThermalHelper::updatePIDBudget(const PIDInfo &pid_info, float value,
+                                     PIDStatus *pid_status) {
+    const auto now = clock_();
+    const float dt = std::chrono::duration<float>(now - pid_status->last_update).count();
+    const float err = pid_info.target - value;
+    pid_status->last_update = now;
+
+    // Only integrate while above target so the controller does not wind up when cool, and let
+    // the integral term unwind back to zero once the sensor drops below target.
+    pid_status->i_budget = std::clamp(pid_status->i_budget + pid_info.k_i * err * dt,
+                                      -pid_info.i_max, 0.0f);
+    float d_budget = 0.0;
+    if (!std::isnan(pid_status->prev_err) && dt > 0) {
+        d_budget = pid_info.k_d * (err - pid_status->prev_err) / dt;
+    }
+    pid_status->prev_err = err;
+
+    pid_status->budget =
+            std::clamp(pid_info.max_budget + pid_info.k_p * err + pid_status->i_budget + d_budget,
+                       pid_info.min_budget, pid_info.max_budget);
+    LOG(VERBOSE) << "PID err: " << err << " i_budget: " << pid_status->i_budget
+                 << " d_budget: " << d_budget << " budget: " << pid_status->budget;
+    return pid_status->budget;
+}
+
+bool ThermalHelper::updateCdevRequests(const std::map<std::string, float> &sensor_budgets) {
+    const auto config = GetConfig();
+    std::map<std::string, size_t> cdev_requests;
+    std::map<std::string, float> cdev_loads;
+    bool cdev_loads_read = false;
+    for (const auto &name_budget_pair : sensor_budgets) {
+        const PIDInfo &pid_info = *config->sensor_info_map.at(name_budget_pair.first).pid_info;
+        if (std::isnan(name_budget_pair.second)) {
+            // The sensor could not be read, do not release the throttling it may be asking for
+            for (const auto &cdev_name : pid_info.cdev_request) {
+                cdev_requests[cdev_name] =
+                        std::max(cdev_requests[cdev_name], cdev_status_map_.at(cdev_name));
+            }
+            continue;
+        }
+        std::vector<float> cdev_budgets;
+        if (pid_info.power_allocator) {
+            if (!cdev_loads_read) {
+                cdev_loads = readCoolingDeviceLoads(*config);
+                cdev_loads_read = true;
+            }
+            cdev_budgets = allocatePowerBudget(pid_info, name_budget_pair.second, cdev_loads,
+                                               config->cooling_device_info_map);
+        } else {
+            // Budget is shared evenly by the cooling devices of the sensor
+            cdev_budgets.assign(pid_info.cdev_request.size(),
+                                name_budget_pair.second / pid_info.cdev_request.size());
+        }
+        for (size_t i = 0; i < pid_info.cdev_request.size(); ++i) {
+            const std::string &cdev_name = pid_info.cdev_request[i];
+            const auto &state2power = config->cooling_device_info_map.at(cdev_name).state2power;
+            // Lowest state fits in the budget, max_state if none does
+            size_t state = 0;
+            while (state < state2power.size() - 1 && state2power[state] > cdev_budgets[i]) {
+                ++state;
+            }
+            LOG(VERBOSE) << name_budget_pair.first << ": " << cdev_name
+                         << " budget: " << cdev_budgets[i] << " state: " << state;
+            // Most throttled request wins when a cooling device is shared by sensors
+            cdev_requests[cdev_name] = std::max(cdev_requests[cdev_name], state);
+        }
+    }
+
+    bool cdev_throttled = false;
+    for (auto &name_state_pair : cdev_status_map_) {
+        const size_t state = cdev_requests[name_state_pair.first];
+        if (state != name_state_pair.second) {
+            if (!cooling_devices_.writeThermalFile(name_state_pair.first, std::to_string(state))) {
+                LOG(ERROR) << "Failed to write cooling device " << name_state_pair.first
+                           << " state " << state;
+                continue;
+            }
+            LOG(INFO) << "PID set cooling device " << name_state_pair.first << " state " << state;
+            name_state_pair.second = state;
+            updateCoolingDeviceStatus(name_state_pair.first, state, clock_());
+        }
+        if (name_state_pair.second != 0) {
+            cdev_throttled = true;
+        }
+    }
+    return cdev_throttled;
+}
+
+std::map<std::string, float> ThermalHelper::readCoolingDeviceLoads(const ThermalConfig &config) {
+    std::map<std::string, float> cdev_loads;
+    hidl_vec<CpuUsage> cpu_usages;
+    for (const auto &name_info_pair : config.cooling_device_info_map) {
+        const CdevInfo &cdev_info = name_info_pair.second;
+        if (!cdev_info.load_path.empty()) {
+            // A percentage, possibly followed by the frequency as in devfreq "load"
+            std::string data;
+            int load;
+            if (!cooling_device_loads_.readThermalFile(name_info_pair.first, &data) ||
+                std::from_chars(data.data(), data.data() + data.size(), load).ec != std::errc()) {
+                LOG(ERROR) << "Failed to read " << name_info_pair.first << " load";
+                continue;
+            }
+            cdev_loads[name_info_pair.first] = std::clamp(load, 0, 100) / 100.0f;
+        } else if (!cdev_info.load_cpus.empty()) {
+            if (cpu_usages.size() == 0) {
+                fillCpuUsages(&cpu_usages);
+            }
+            CdevLoadStatus cpu_time = {.active = 0, .total = 0};
+            for (const auto cpu : cdev_info.load_cpus) {
+                if (cpu < cpu_usages.size() && cpu_usages[cpu].isOnline) {
+                    cpu_time.active += cpu_usages[cpu].active;
+                    cpu_time.total += cpu_usages[cpu].total;
+                }
+            }
+            // Busy ratio since the previous allocation, fully loaded on the first one
+            const auto it = cdev_load_map_.find(name_info_pair.first);
+            float load = 1.0;
+            if (it != cdev_load_map_.end() && cpu_time.total > it->second.total &&
+                cpu_time.active >= it->second.active) {
+                load = static_cast<float>(cpu_time.active - it->second.active) /
+                       (cpu_time.total - it->second.total);
+            }
+            cdev_load_map_[name_info_pair.first] = cpu_time;
+            cdev_loads[name_info_pair.first] = std::min(load, 1.0f);
+        }
+    }
+    return cdev_loads;
+}
+
 // This is called in the different thread context and will update sensor_status
 // uevent_sensors is the set of sensors which trigger uevent from thermal core driver.
 bool ThermalHelper::thermalWatcherCallbackFunc(const std::set<std::string> &uevent_sensors) {
+    applyPendingConfig();
+    const auto config = GetConfig();
+    const auto now = clock_();
     std::vector<Temperature_2_0> temps;
     bool thermal_triggered = false;
+
+    // Read every sensor this pass needs from sysfs in one batch, the reads below are then served
+    // from the cache.
+    std::vector<std::string_view> sensor_names;
+    for (const auto &name_info_pair : config->sensor_info_map) {
+        if ((name_info_pair.second.is_monitor &&
+             (uevent_sensors.empty() || uevent_sensors.count(name_info_pair.first) ||
+              sensor_status_map_.at(name_info_pair.first).notification_pending)) ||
+            name_info_pair.second.pid_info != nullptr) {
+            sensor_names.emplace_back(name_info_pair.first);
+        }
+    }
+    prefetchSensorValues(sensor_names, true);
+
     for (auto &name_status_pair : sensor_status_map_) {
         Temperature_2_0 temp;
         TemperatureThreshold threshold;
         SensorStatus &sensor_status = name_status_pair.second;
-        const SensorInfo &sensor_info = sensor_info_map_.at(name_status_pair.first);
+        const SensorInfo &sensor_info = config->sensor_info_map.at(name_status_pair.first);
         // Only send notification on whitelisted sensors
         if (!sensor_info.is_monitor) {
             continue;
         }
-        // If callback is triggered by uevent, only check the sensors within uevent_sensors
+        // If callback is triggered by uevent, only check the sensors within uevent_sensors and
+        // the ones with a notification pending
         if (uevent_sensors.size() != 0 &&
-            uevent_sensors.find(name_status_pair.first) == uevent_sensors.end()) {
+            uevent_sensors.find(name_status_pair.first) == uevent_sensors.end() &&
+            !sensor_status.notification_pending) {
             if (sensor_status.severity != ThrottlingSeverity::NONE) {
                 thermal_triggered = true;
             }
@@ -599,28 +1340,96 @@ bool ThermalHelper::thermalWatcherCallbackFunc(const std::set<std::string> &ueve
             continue;
         }
 
+        sensor_history_map_.at(name_status_pair.first)
+                .record(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                now.time_since_epoch())
+                                .count(),
+                        temp.value, temp.throttlingStatus);
+        if (ATRACE_ENABLED()) {
+            const SensorTraceNames &trace_names = sensor_trace_names_.at(name_status_pair.first);
+            ATRACE_INT(trace_names.temperature.c_str(), static_cast<int32_t>(temp.value * 1000));
+            ATRACE_INT(trace_names.severity.c_str(), static_cast<int32_t>(temp.throttlingStatus));
+        }
+
         {
             // writer lock
             std::unique_lock<std::shared_mutex> _lock(sensor_status_map_mutex_);
+            const ThrottlingSeverity prev_severity =
+                    std::max(sensor_status.prev_hot_severity, sensor_status.prev_cold_severity);
+            if (temp.throttlingStatus != prev_severity && sensor_status.notification_pending) {
+                // The pending change is superseded before being notified
+                ++sensor_status.suppressed_notification_count;
+            }
+            if (temp.throttlingStatus != sensor_status.severity) {
+                sensor_status.notification_pending = true;
+            }
             if (throtting_status.first != sensor_status.prev_hot_severity) {
                 sensor_status.prev_hot_severity = throtting_status.first;
             }
             if (throtting_status.second != sensor_status.prev_cold_severity) {
                 sensor_status.prev_cold_severity = throtting_status.second;
             }
-            if (temp.throttlingStatus != sensor_status.severity) {
-                temps.push_back(temp);
-                sensor_status.severity = temp.throttlingStatus;
+            // Only the latest severity is notified once the interval has passed
+            if (sensor_status.notification_pending &&
+                (sensor_status.notification_count == 0 ||
+                 now - sensor_status.last_notification_time >=
+                         sensor_info.notification_interval)) {
+                sensor_status.notification_pending = false;
+                if (temp.throttlingStatus != sensor_status.severity) {
+                    temps.push_back(temp);
+                    sensor_status.severity = temp.throttlingStatus;
+                    sensor_status.last_notification_time = now;
+                    ++sensor_status.notification_count;
+                } else {
+                    // Back to the notified severity, nothing to notify
+                    ++sensor_status.suppressed_notification_count;
+                }
             }
         }
-        if (sensor_status.severity != ThrottlingSeverity::NONE) {
+        if (sensor_status.severity != ThrottlingSeverity::NONE ||
+            sensor_status.notification_pending) {
             thermal_triggered = true;
         }
     }
     if (!temps.empty() && cb_) {
+        if (ATRACE_ENABLED()) {
+            // Zero length slices mark the notifications on the watcher thread
+            for (const auto &t : temps) {
+                ATRACE_BEGIN(sensor_trace_names_.at(t.name)
+                                     .notification[static_cast<size_t>(t.throttlingStatus)]
+                                     .c_str());
+                ATRACE_END();
+            }
+        }
         cb_(temps);
     }
 
+    if (!cdev_status_map_.empty()) {
+        std::map<std::string, float> sensor_budgets;
+        for (auto &name_status_pair : pid_status_map_) {
+            const SensorInfo &sensor_info = config->sensor_info_map.at(name_status_pair.first);
+            if (sensor_info.pid_info == nullptr) {
+                continue;
+            }
+            float value;
+            if (!readSensorValue(name_status_pair.first, &value, false)) {
+                LOG(ERROR) << __func__
+                           << ": error reading temperature for sensor: " << name_status_pair.first;
+                // Keep the PID state and hold the cooling devices where they are
+                sensor_budgets[name_status_pair.first] = NAN;
+                continue;
+            }
+            sensor_budgets[name_status_pair.first] = updatePIDBudget(
+                    *sensor_info.pid_info, value, &name_status_pair.second);
+        }
+        if (updateCdevRequests(sensor_budgets)) {
+            thermal_triggered = true;
+        }
+    }
+
+    // Not every cooling device driver calls sysfs_notify() on cur_state, poll the others.
+    refreshCoolingDeviceStatus(true);
+
     return thermal_triggered;
 }
 
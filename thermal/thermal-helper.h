@@ -32,6 +32,8 @@
 
 #include <array>
 #include <chrono>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <shared_mutex>
 #include <string>
@@ -44,6 +46,7 @@
 
 #include "utils/config_parser.h"
 #include "utils/thermal_files.h"
+#include "utils/thermal_history.h"
 #include "utils/thermal_watcher.h"
 
 namespace android {
@@ -68,15 +71,76 @@ using ::android::hardware::thermal::V2_0::ThrottlingSeverity;
 using NotificationCallback = std::function<void(const std::vector<Temperature_2_0> &temps)>;
 using NotificationTime = std::chrono::time_point<std::chrono::steady_clock>;
 
+struct PIDStatus {
+    float i_budget;
+    float prev_err;
+    float budget;
+    NotificationTime last_update;
+};
+
+// /proc/stat times of the cpus of a cooling device at the previous power allocation
+struct CdevLoadStatus {
+    uint64_t active;
+    uint64_t total;
+};
+
 struct SensorStatus {
+    // Last notified severity
     ThrottlingSeverity severity;
     ThrottlingSeverity prev_hot_severity;
     ThrottlingSeverity prev_cold_severity;
+    NotificationTime last_notification_time;
+    // A severity change is held back until notification_interval has passed
+    bool notification_pending;
+    uint64_t notification_count;
+    // Severity changes coalesced into a later notification or reverted before being notified
+    uint64_t suppressed_notification_count;
+};
+
+// Trace counter and event names of a monitored sensor, formatted once so tracing a watcher pass
+// does not allocate.
+struct SensorTraceNames {
+    // Temperature counter, in milli-Celsius
+    std::string temperature;
+    std::string severity;
+    // Notification events, indexed by the notified severity
+    std::array<std::string, kThrottlingSeverityCount> notification;
+};
+
+struct CoolingDeviceStatus {
+    size_t state;
+    NotificationTime last_change;
+    // Time spent in each state, indexed by state, up to last_change
+    std::vector<std::chrono::milliseconds> time_in_state;
+    uint64_t change_count;
+};
+
+struct SensorReading {
+    float value;
+    NotificationTime read_time;
+};
+
+// Where ThermalHelper finds its config and sysfs nodes, and how it tells time. Host tools
+// override these to run against a fake sysfs tree in simulated time.
+struct ThermalHelperOptions {
+    std::string config_path;
+    // Root of the thermal_zone* and cooling_device* nodes.
+    std::string thermal_root;
+    std::function<NotificationTime()> clock;
+    // Tools leave the watcher thread stopped and call runWatcherPass() instead.
+    bool start_watcher;
+};
+
+// Parsed thermal config, replaced as a whole when the config is reloaded.
+struct ThermalConfig {
+    std::map<std::string, CdevInfo> cooling_device_info_map;
+    std::map<std::string, SensorInfo> sensor_info_map;
 };
 
 class ThermalHelper {
   public:
     ThermalHelper(const NotificationCallback &cb);
+    ThermalHelper(const NotificationCallback &cb, const ThermalHelperOptions &options);
     ~ThermalHelper() = default;
 
     bool fillTemperatures(hidl_vec<Temperature_1_0> *temperatures) const;
@@ -98,37 +162,135 @@ class ThermalHelper {
     bool readTemperature(std::string_view sensor_name, Temperature_1_0 *out) const;
     bool readTemperature(
             std::string_view sensor_name, Temperature_2_0 *out,
-            std::pair<ThrottlingSeverity, ThrottlingSeverity> *throtting_status = nullptr) const;
+            std::pair<ThrottlingSeverity, ThrottlingSeverity> *throtting_status = nullptr,
+            bool force_sysfs = false) const;
     bool readTemperatureThreshold(std::string_view sensor_name, TemperatureThreshold *out) const;
     // Read the value of a single cooling device.
     bool readCoolingDevice(std::string_view cooling_device, CoolingDevice_2_0 *out) const;
-    // Get SensorInfo Map
-    const std::map<std::string, SensorInfo> &GetSensorInfoMap() const { return sensor_info_map_; }
+    // Get a snapshot of the current config, it stays valid across a config reload.
+    std::shared_ptr<const ThermalConfig> GetConfig() const { return std::atomic_load(&config_); }
+    // Parse and validate the config at config_path, or the config loaded at boot if empty, and
+    // hand it to the watcher thread to swap in. Sensors and cooling devices can be retuned but
+    // not added, removed or (un)monitored, as their sysfs nodes are bound at boot.
+    bool reloadConfig(std::string_view config_path);
+    // Run one pass of the watcher loop on the calling thread, for tools running with the watcher
+    // thread stopped. Return true if any sensor is throttled.
+    bool runWatcherPass() { return thermalWatcherCallbackFunc({}); }
+    // Number of sensor sysfs reads so far.
+    uint64_t GetSensorReadCount() const { return thermal_sensors_.getNumReads(); }
+    // Get a copy of the state of all cooling devices, with the time in state accounted up to now
+    std::map<std::string, CoolingDeviceStatus> GetCoolingDeviceStatusMap() const;
+    // Get a copy of the status of all sensors
+    std::map<std::string, SensorStatus> GetSensorStatusMap() const;
+    // Get the reading history of monitored sensors
+    const std::map<std::string, SensorHistory> &GetSensorHistoryMap() const {
+        return sensor_history_map_;
+    }
+    // Current time on the clock of the history timestamps
+    int64_t GetHistoryTimeMs() const {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(clock_().time_since_epoch())
+                .count();
+    }
 
   private:
     bool initializeSensorMap(const std::map<std::string, std::string> &path_map);
     bool initializeCoolingDevices(const std::map<std::string, std::string> &path_map);
-    bool initializeTrip(const std::map<std::string, std::string> &path_map);
+    bool initializeTrip(const std::map<std::string, std::string> &path_map,
+                        const std::map<std::string, SensorInfo> &sensor_info_map);
+    bool initializePID();
+    // Check a reloaded config against the current one.
+    bool validateConfig(const ThermalConfig &new_config);
+    // Swap in the config queued by reloadConfig(), watcher thread only.
+    void applyPendingConfig();
+
+    // Read the scaled value of a single sensor, served from sensor_cache_map_ when the cached
+    // reading is younger than sensor_cache_budget_ and force_sysfs is not set. Virtual sensors
+    // are computed from their linked sensors on every read.
+    bool readSensorValue(std::string_view sensor_name, float *value, bool force_sysfs) const;
+    // Read a physical sensor from sysfs, bypassing the cache.
+    bool readSensorFile(std::string_view sensor_name, const SensorInfo &sensor_info,
+                        float *value) const;
+    // Refresh the cached readings of the physical sensors behind sensor_names in one batch, so
+    // a sweep over many sensors takes the cache lock once. Cached readings younger than
+    // sensor_cache_budget_ are kept unless force_sysfs is set.
+    void prefetchSensorValues(const std::vector<std::string_view> &sensor_names,
+                              bool force_sysfs) const;
+    // Evaluate a virtual sensor's formula over its linked sensors.
+    bool computeVirtualSensorValue(std::string_view sensor_name,
+                                   const VirtualSensorInfo &virtual_sensor_info,
+                                   float *value) const;
 
     // For thermal_watcher_'s polling thread
     bool thermalWatcherCallbackFunc(const std::set<std::string> &uevent_sensors);
+    // For thermal_watcher_'s cooling device notifications
+    void cdevWatcherCallbackFunc(const std::map<std::string, std::string> &cdev_states);
+    // Record the state of a cooling device, accounting the time spent in its previous state.
+    void updateCoolingDeviceStatus(std::string_view cooling_device, size_t state,
+                                   NotificationTime now) const;
+    // Read the cooling devices into cooling_device_status_map_, all of them or only those which
+    // have not delivered a sysfs_notify() event.
+    void refreshCoolingDeviceStatus(bool skip_notifying) const;
     // Return hot and cold severity status as std::pair
     std::pair<ThrottlingSeverity, ThrottlingSeverity> getSeverityFromThresholds(
         const ThrottlingArray &hot_thresholds, const ThrottlingArray &cold_thresholds,
         const ThrottlingArray &hot_hysteresis, const ThrottlingArray &cold_hysteresis,
         ThrottlingSeverity prev_hot_severity, ThrottlingSeverity prev_cold_severity,
         float value) const;
+    // Run the PID controller of a sensor and return its power budget in mW
+    float updatePIDBudget(const PIDInfo &pid_info, float value, PIDStatus *pid_status);
+    // Convert the PID budgets to cooling device states and write the changed ones. A NAN budget
+    // holds the cooling devices of the sensor at their current state.
+    // Return true if any cooling device is throttled by PID.
+    bool updateCdevRequests(const std::map<std::string, float> &sensor_budgets);
+    // Read the load, from 0 to 1, of the cooling devices configured with a load source.
+    std::map<std::string, float> readCoolingDeviceLoads(const ThermalConfig &config);
 
     sp<ThermalWatcher> thermal_watcher_;
     ThermalFiles thermal_sensors_;
     ThermalFiles cooling_devices_;
+    // Load nodes of the cooling devices with a LoadPath
+    ThermalFiles cooling_device_loads_;
     bool is_initialized_;
     const NotificationCallback cb_;
-    const std::map<std::string, CoolingType> cooling_device_info_map_;
-    const std::map<std::string, SensorInfo> sensor_info_map_;
+    const std::string config_path_;
+    const std::string thermal_root_;
+    const std::function<NotificationTime()> clock_;
+    // Accessed with std::atomic_load/std::atomic_store, only swapped by the watcher thread.
+    std::shared_ptr<const ThermalConfig> config_;
+    // Config validated by reloadConfig() and waiting for the watcher thread.
+    std::shared_ptr<const ThermalConfig> pending_config_;
+    // Serializes reloadConfig() calls.
+    std::mutex config_reload_mutex_;
+    // Thermal zone paths by sensor name, to update trip points on reload.
+    std::map<std::string, std::string> tz_map_;
+    bool uevent_monitor_;
 
     mutable std::shared_mutex sensor_status_map_mutex_;
     std::map<std::string, SensorStatus> sensor_status_map_;
+    // Written by the watcher thread only, keys are fixed after construction.
+    std::map<std::string, SensorHistory> sensor_history_map_;
+    // PID controller state of each sensor, watcher thread only so it is kept out of
+    // sensor_status_map_ which binder threads copy.
+    std::map<std::string, PIDStatus> pid_status_map_;
+    // Monitored sensors only, keys are fixed after construction.
+    std::map<std::string, SensorTraceNames> sensor_trace_names_;
+
+    // Cooling device state last written by the PID controllers, watcher thread only.
+    std::map<std::string, size_t> cdev_status_map_;
+    // Cooling devices with LoadCpus, watcher thread only.
+    std::map<std::string, CdevLoadStatus> cdev_load_map_;
+    // Cooling devices whose driver calls sysfs_notify() on cur_state, watcher thread only.
+    std::set<std::string> notifying_cdevs_;
+
+    // Last known state of each cooling device, updated by reads, PID requests, sysfs_notify()
+    // and the watcher polling.
+    mutable std::shared_mutex cooling_device_status_map_mutex_;
+    mutable std::map<std::string, CoolingDeviceStatus> cooling_device_status_map_;
+
+    // Last reading of each sensor, refreshed by the watcher thread and by cache misses.
+    const std::chrono::milliseconds sensor_cache_budget_;
+    mutable std::shared_mutex sensor_cache_map_mutex_;
+    mutable std::unordered_map<std::string, SensorReading> sensor_cache_map_;
 };
 
 }  // namespace implementation
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Validate a thermal JSON config at build time and compile it into the binary form loaded by
+// the thermal HAL, see utils/config_blob.h.
+//
+// Usage: thermal_config_compiler <thermal_info_config.json> <thermal_info_config.bin>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+
+#include <json/reader.h>
+#include <json/value.h>
+
+#include "utils/config_blob.h"
+#include "utils/config_parser.h"
+
+using ::android::hardware::thermal::V2_0::implementation::CdevInfo;
+using ::android::hardware::thermal::V2_0::implementation::ParseThermalConfig;
+using ::android::hardware::thermal::V2_0::implementation::SensorInfo;
+using ::android::hardware::thermal::V2_0::implementation::SerializeThermalConfig;
+using ::android::hardware::thermal::V2_0::implementation::ValidatePIDCoolingDevices;
+
+int main(int argc, char **argv) {
+    android::base::InitLogging(argv, android::base::StderrLogger);
+    if (argc != 3) {
+        LOG(ERROR) << "Usage: " << argv[0] << " <config.json> <config.bin>";
+        return 1;
+    }
+    const std::string config_path = argv[1];
+    const std::string blob_path = argv[2];
+
+    std::string json_doc;
+    if (!android::base::ReadFileToString(config_path, &json_doc)) {
+        PLOG(ERROR) << "Failed to read JSON config from " << config_path;
+        return 1;
+    }
+    Json::Value root;
+    Json::Reader reader;
+    if (!reader.parse(json_doc, root)) {
+        LOG(ERROR) << "Failed to parse JSON config " << config_path << ": "
+                   << reader.getFormattedErrorMessages();
+        return 1;
+    }
+
+    // The parser returns an empty map on any invalid entry.
+    std::map<std::string, SensorInfo> sensor_info_map;
+    std::map<std::string, CdevInfo> cooling_device_info_map;
+    ParseThermalConfig(config_path, &sensor_info_map, &cooling_device_info_map);
+    if (sensor_info_map.empty() || sensor_info_map.size() != root["Sensors"].size()) {
+        LOG(ERROR) << config_path << ": invalid Sensors";
+        return 1;
+    }
+    if (cooling_device_info_map.size() != root["CoolingDevices"].size()) {
+        LOG(ERROR) << config_path << ": invalid CoolingDevices";
+        return 1;
+    }
+    if (!ValidatePIDCoolingDevices(sensor_info_map, cooling_device_info_map)) {
+        LOG(ERROR) << config_path << ": invalid PIDInfo";
+        return 1;
+    }
+
+    if (!android::base::WriteStringToFile(
+                SerializeThermalConfig(json_doc, sensor_info_map, cooling_device_info_map),
+                blob_path)) {
+        PLOG(ERROR) << "Failed to write " << blob_path;
+        return 1;
+    }
+    LOG(INFO) << "Compiled " << config_path << " to " << blob_path;
+    return 0;
+}
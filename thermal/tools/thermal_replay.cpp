@@ -0,0 +1,308 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Replay a recorded temperature trace through ThermalHelper on the host, to evaluate polling,
+// threshold and hysteresis changes before they reach devices.
+//
+// Usage: thermal_replay <thermal_info_config.json> <trace.csv> [poll_interval_ms]
+//
+// The trace is a CSV file with a "time_ms,<sensor>,<sensor>,..." header followed by one row per
+// sample, with values in sysfs units. Every non-virtual sensor of the config needs a column.
+// The tool builds a fake sysfs tree from the config, then runs one watcher pass every
+// poll_interval_ms (2000 by default, the watcher polling interval) of simulated time, and reports
+// the notifications sent, the sysfs reads, the CPU time spent in the watcher, and the time spent
+// in each severity and cooling device state.
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+
+#include "thermal-helper.h"
+
+using ::android::base::StringPrintf;
+using ::android::hardware::thermal::V2_0::implementation::CdevInfo;
+using ::android::hardware::thermal::V2_0::implementation::NotificationTime;
+using ::android::hardware::thermal::V2_0::implementation::ParseThermalConfig;
+using ::android::hardware::thermal::V2_0::implementation::SensorInfo;
+using ::android::hardware::thermal::V2_0::implementation::Temperature_2_0;
+using ::android::hardware::thermal::V2_0::implementation::ThermalHelper;
+using ::android::hardware::thermal::V2_0::implementation::ThermalHelperOptions;
+using ::android::hardware::thermal::V2_0::implementation::ThrottlingSeverity;
+
+namespace {
+
+constexpr int64_t kDefaultPollIntervalMs = 2000;
+
+struct TraceSample {
+    int64_t time_ms;
+    std::vector<std::string> values;
+};
+
+struct Trace {
+    std::vector<std::string> sensors;
+    std::vector<TraceSample> samples;
+};
+
+bool parseTrace(const std::string &trace_path, Trace *trace) {
+    std::string data;
+    if (!android::base::ReadFileToString(trace_path, &data)) {
+        PLOG(ERROR) << "Failed to read trace " << trace_path;
+        return false;
+    }
+    std::vector<std::string> lines = android::base::Split(android::base::Trim(data), "\n");
+    std::vector<std::string> header = android::base::Split(lines[0], ",");
+    if (header.size() < 2 || android::base::Trim(header[0]) != "time_ms") {
+        LOG(ERROR) << trace_path << ": header must be time_ms,<sensor>,...";
+        return false;
+    }
+    for (size_t i = 1; i < header.size(); ++i) {
+        trace->sensors.emplace_back(android::base::Trim(header[i]));
+    }
+
+    for (size_t i = 1; i < lines.size(); ++i) {
+        std::vector<std::string> fields = android::base::Split(lines[i], ",");
+        TraceSample sample;
+        if (fields.size() != header.size() ||
+            !android::base::ParseInt(android::base::Trim(fields[0]), &sample.time_ms) ||
+            (!trace->samples.empty() && sample.time_ms < trace->samples.back().time_ms)) {
+            LOG(ERROR) << trace_path << ":" << i + 1 << ": invalid sample";
+            return false;
+        }
+        for (size_t j = 1; j < fields.size(); ++j) {
+            sample.values.emplace_back(android::base::Trim(fields[j]));
+        }
+        trace->samples.emplace_back(std::move(sample));
+    }
+    if (trace->samples.empty()) {
+        LOG(ERROR) << trace_path << ": no samples";
+        return false;
+    }
+    return true;
+}
+
+// A fake /sys/devices/virtual/thermal with the nodes ThermalHelper needs, removed on destruction.
+class FakeSysfs {
+  public:
+    bool create() {
+        char root[] = "/tmp/thermal_replay.XXXXXX";
+        if (mkdtemp(root) == nullptr) {
+            PLOG(ERROR) << "Failed to create fake sysfs";
+            return false;
+        }
+        root_ = root;
+        return true;
+    }
+    ~FakeSysfs() {
+        for (auto it = files_.rbegin(); it != files_.rend(); ++it) {
+            unlink(it->c_str());
+        }
+        for (auto it = dirs_.rbegin(); it != dirs_.rend(); ++it) {
+            rmdir(it->c_str());
+        }
+        if (!root_.empty()) {
+            rmdir(root_.c_str());
+        }
+    }
+
+    // Add a thermal zone and return the path of its temp node.
+    std::string addSensor(std::string_view name, std::string_view temp) {
+        const std::string dir = addDir(StringPrintf("thermal_zone%zu", num_sensors_++));
+        writeFile(dir + "/type", name);
+        // Anything but user_space, the watcher runs in polling mode.
+        writeFile(dir + "/policy", "step_wise");
+        writeFile(dir + "/temp", temp);
+        return dir + "/temp";
+    }
+    void addCoolingDevice(std::string_view name) {
+        const std::string dir = addDir(StringPrintf("cooling_device%zu", num_cdevs_++));
+        writeFile(dir + "/type", name);
+        writeFile(dir + "/cur_state", "0");
+    }
+    bool writeFile(const std::string &path, std::string_view data) {
+        if (std::find(files_.begin(), files_.end(), path) == files_.end()) {
+            files_.emplace_back(path);
+        }
+        return android::base::WriteStringToFile(std::string(data) + "\n", path);
+    }
+    const std::string &getRoot() const { return root_; }
+
+  private:
+    std::string addDir(const std::string &name) {
+        const std::string dir = root_ + "/" + name;
+        mkdir(dir.c_str(), 0755);
+        dirs_.emplace_back(dir);
+        return dir;
+    }
+
+    std::string root_;
+    std::vector<std::string> dirs_;
+    std::vector<std::string> files_;
+    size_t num_sensors_ = 0;
+    size_t num_cdevs_ = 0;
+};
+
+int64_t threadCpuTimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    android::base::InitLogging(argv, android::base::StderrLogger);
+    if (argc != 3 && argc != 4) {
+        LOG(ERROR) << "Usage: " << argv[0] << " <config.json> <trace.csv> [poll_interval_ms]";
+        return 1;
+    }
+    const std::string config_path = argv[1];
+    int64_t poll_interval_ms = kDefaultPollIntervalMs;
+    if (argc == 4 && !android::base::ParseInt(argv[3], &poll_interval_ms, int64_t(1))) {
+        LOG(ERROR) << "Invalid poll interval " << argv[3];
+        return 1;
+    }
+    Trace trace;
+    if (!parseTrace(argv[2], &trace)) {
+        return 1;
+    }
+
+    // Build the fake sysfs tree, with each sensor at its first traced value.
+    FakeSysfs sysfs;
+    if (!sysfs.create()) {
+        return 1;
+    }
+    std::map<std::string, SensorInfo> sensor_info_map;
+    std::map<std::string, CdevInfo> cooling_device_info_map;
+    ParseThermalConfig(config_path, &sensor_info_map, &cooling_device_info_map);
+    std::vector<std::string> temp_paths(trace.sensors.size());
+    for (const auto &name_info_pair : sensor_info_map) {
+        if (name_info_pair.second.virtual_sensor_info != nullptr) {
+            continue;
+        }
+        auto it = std::find(trace.sensors.begin(), trace.sensors.end(), name_info_pair.first);
+        if (it == trace.sensors.end()) {
+            LOG(ERROR) << "Sensor " << name_info_pair.first << " is not in the trace";
+            return 1;
+        }
+        const size_t column = it - trace.sensors.begin();
+        temp_paths[column] =
+                sysfs.addSensor(name_info_pair.first, trace.samples[0].values[column]);
+    }
+    for (const auto &name_info_pair : cooling_device_info_map) {
+        sysfs.addCoolingDevice(name_info_pair.first);
+    }
+
+    NotificationTime now(std::chrono::milliseconds(trace.samples[0].time_ms));
+    std::map<ThrottlingSeverity, size_t> notifications;
+    size_t num_notifications = 0;
+    int64_t time_ms = trace.samples[0].time_ms;
+    ThermalHelper thermal_helper(
+            [&](const std::vector<Temperature_2_0> &temps) {
+                for (const auto &t : temps) {
+                    std::cout << time_ms << "ms: " << t.name << " " << t.value << " "
+                              << toString(t.throttlingStatus) << std::endl;
+                    ++notifications[t.throttlingStatus];
+                    ++num_notifications;
+                }
+            },
+            {
+                    .config_path = config_path,
+                    .thermal_root = sysfs.getRoot(),
+                    .clock = [&now] { return now; },
+                    .start_watcher = false,
+            });
+
+    size_t num_passes = 0;
+    size_t next_sample = 0;
+    int64_t cpu_time_ns = 0;
+    const uint64_t start_reads = thermal_helper.GetSensorReadCount();
+    const auto start_wall_time = std::chrono::steady_clock::now();
+    for (; time_ms <= trace.samples.back().time_ms; time_ms += poll_interval_ms) {
+        // Only the latest sample before this pass is visible in sysfs.
+        const size_t prev_sample = next_sample;
+        while (next_sample < trace.samples.size() &&
+               trace.samples[next_sample].time_ms <= time_ms) {
+            ++next_sample;
+        }
+        if (next_sample != prev_sample) {
+            const auto &values = trace.samples[next_sample - 1].values;
+            for (size_t i = 0; i < values.size(); ++i) {
+                if (!temp_paths[i].empty()) {
+                    sysfs.writeFile(temp_paths[i], values[i]);
+                }
+            }
+        }
+
+        now = NotificationTime(std::chrono::milliseconds(time_ms));
+        const int64_t start_cpu_time_ns = threadCpuTimeNs();
+        thermal_helper.runWatcherPass();
+        cpu_time_ns += threadCpuTimeNs() - start_cpu_time_ns;
+        ++num_passes;
+    }
+    const float wall_time_s =
+            std::chrono::duration<float>(std::chrono::steady_clock::now() - start_wall_time)
+                    .count();
+
+    const float simulated_s = (trace.samples.back().time_ms - trace.samples[0].time_ms) / 1000.0;
+    const uint64_t num_reads = thermal_helper.GetSensorReadCount() - start_reads;
+    std::cout << "Passes: " << num_passes << " every " << poll_interval_ms << "ms, "
+              << simulated_s << "s simulated in " << wall_time_s << "s" << std::endl;
+    std::cout << "Notifications: " << num_notifications;
+    for (const auto &severity_count_pair : notifications) {
+        std::cout << " " << toString(severity_count_pair.first) << ": "
+                  << severity_count_pair.second;
+    }
+    uint64_t num_suppressed = 0;
+    for (const auto &name_status_pair : thermal_helper.GetSensorStatusMap()) {
+        num_suppressed += name_status_pair.second.suppressed_notification_count;
+    }
+    std::cout << " Suppressed: " << num_suppressed << std::endl;
+    std::cout << "Sensor reads: " << num_reads << ", "
+              << (simulated_s > 0 ? num_reads / simulated_s : 0) << "/s simulated" << std::endl;
+    std::cout << "Watcher CPU time: " << cpu_time_ns / 1000000.0 << "ms, "
+              << cpu_time_ns / 1000.0 / num_passes << "us per pass" << std::endl;
+    for (const auto &name_history_pair : thermal_helper.GetSensorHistoryMap()) {
+        std::cout << "Sensor " << name_history_pair.first << ": time in severity ms:";
+        for (const int64_t time_ms :
+             name_history_pair.second.getTimeInSeverityMs(thermal_helper.GetHistoryTimeMs())) {
+            std::cout << " " << time_ms;
+        }
+        std::cout << std::endl;
+    }
+    for (const auto &name_status_pair : thermal_helper.GetCoolingDeviceStatusMap()) {
+        std::cout << "Cooling device " << name_status_pair.first
+                  << ": changes: " << name_status_pair.second.change_count << " time in state ms:";
+        for (const auto &time_in_state : name_status_pair.second.time_in_state) {
+            std::cout << " " << time_in_state.count();
+        }
+        std::cout << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,400 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cstring>
+
+#include <android-base/logging.h>
+#include <android-base/unique_fd.h>
+
+#include "config_blob.h"
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V2_0 {
+namespace implementation {
+
+namespace {
+
+constexpr std::string_view kBlobMagic("THCF");
+constexpr uint32_t kBlobVersion = 3;
+constexpr std::string_view kJsonSuffix(".json");
+constexpr std::string_view kBlobSuffix(".bin");
+
+struct BlobHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t json_hash;
+    uint32_t sensors_offset;
+    uint32_t cdevs_offset;
+};
+
+class BlobWriter {
+  public:
+    template <typename T>
+    void write(const T &value) {
+        data_.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+    void writeString(std::string_view str) {
+        write<uint16_t>(str.size());
+        data_.append(str);
+    }
+    template <typename T>
+    void writeVector(const std::vector<T> &values) {
+        write<uint32_t>(values.size());
+        for (const auto &value : values) {
+            write(value);
+        }
+    }
+    void writeStringVector(const std::vector<std::string> &values) {
+        write<uint32_t>(values.size());
+        for (const auto &value : values) {
+            writeString(value);
+        }
+    }
+    size_t size() const { return data_.size(); }
+    std::string *data() { return &data_; }
+
+  private:
+    std::string data_;
+};
+
+// Reads values off a blob, every read fails once the blob is exhausted.
+class BlobReader {
+  public:
+    explicit BlobReader(std::string_view data) : data_(data) {}
+
+    template <typename T>
+    bool read(T *out) {
+        if (data_.size() < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(out, data_.data(), sizeof(T));
+        data_.remove_prefix(sizeof(T));
+        return true;
+    }
+    bool readString(std::string *out) {
+        uint16_t size;
+        if (!read(&size) || data_.size() < size) {
+            return false;
+        }
+        out->assign(data_.data(), size);
+        data_.remove_prefix(size);
+        return true;
+    }
+    template <typename T>
+    bool readVector(std::vector<T> *out) {
+        uint32_t size;
+        if (!read(&size) || data_.size() < static_cast<uint64_t>(size) * sizeof(T)) {
+            return false;
+        }
+        out->resize(size);
+        for (auto &value : *out) {
+            read(&value);
+        }
+        return true;
+    }
+    bool readStringVector(std::vector<std::string> *out) {
+        uint32_t size;
+        if (!read(&size)) {
+            return false;
+        }
+        out->clear();
+        for (uint32_t i = 0; i < size; ++i) {
+            std::string value;
+            if (!readString(&value)) {
+                return false;
+            }
+            out->emplace_back(std::move(value));
+        }
+        return true;
+    }
+
+  private:
+    std::string_view data_;
+};
+
+void writeSensorInfo(BlobWriter *writer, const SensorInfo &sensor_info) {
+    writer->write(sensor_info.type);
+    writer->write(sensor_info.hot_thresholds);
+    writer->write(sensor_info.cold_thresholds);
+    writer->write(sensor_info.hot_hysteresis);
+    writer->write(sensor_info.cold_hysteresis);
+    writer->write(sensor_info.vr_threshold);
+    writer->write(sensor_info.multiplier);
+    writer->write<uint8_t>(sensor_info.is_monitor);
+    writer->write(sensor_info.notification_interval);
+
+    writer->write<uint8_t>(sensor_info.virtual_sensor_info != nullptr);
+    if (sensor_info.virtual_sensor_info != nullptr) {
+        const VirtualSensorInfo &virtual_sensor_info = *sensor_info.virtual_sensor_info;
+        writer->writeStringVector(virtual_sensor_info.linked_sensors);
+        writer->writeVector(virtual_sensor_info.coefficients);
+        writer->write(virtual_sensor_info.offset);
+        writer->write(virtual_sensor_info.formula);
+    }
+
+    writer->write<uint8_t>(sensor_info.pid_info != nullptr);
+    if (sensor_info.pid_info != nullptr) {
+        const PIDInfo &pid_info = *sensor_info.pid_info;
+        writer->write(pid_info.target);
+        writer->write(pid_info.k_p);
+        writer->write(pid_info.k_i);
+        writer->write(pid_info.k_d);
+        writer->write(pid_info.i_max);
+        writer->write(pid_info.max_budget);
+        writer->write(pid_info.min_budget);
+        writer->writeStringVector(pid_info.cdev_request);
+        writer->write<uint8_t>(pid_info.power_allocator);
+        writer->writeVector(pid_info.cdev_weight);
+    }
+}
+
+bool readSensorInfo(BlobReader *reader, SensorInfo *sensor_info) {
+    uint8_t is_monitor, has_virtual_sensor_info, has_pid_info;
+    if (!reader->read(&sensor_info->type) || !reader->read(&sensor_info->hot_thresholds) ||
+        !reader->read(&sensor_info->cold_thresholds) ||
+        !reader->read(&sensor_info->hot_hysteresis) ||
+        !reader->read(&sensor_info->cold_hysteresis) ||
+        !reader->read(&sensor_info->vr_threshold) || !reader->read(&sensor_info->multiplier) ||
+        !reader->read(&is_monitor) || !reader->read(&sensor_info->notification_interval)) {
+        return false;
+    }
+    sensor_info->is_monitor = is_monitor;
+
+    if (!reader->read(&has_virtual_sensor_info)) {
+        return false;
+    }
+    if (has_virtual_sensor_info) {
+        auto virtual_sensor_info = std::make_unique<VirtualSensorInfo>();
+        if (!reader->readStringVector(&virtual_sensor_info->linked_sensors) ||
+            !reader->readVector(&virtual_sensor_info->coefficients) ||
+            !reader->read(&virtual_sensor_info->offset) ||
+            !reader->read(&virtual_sensor_info->formula)) {
+            return false;
+        }
+        sensor_info->virtual_sensor_info = std::move(virtual_sensor_info);
+    }
+
+    if (!reader->read(&has_pid_info)) {
+        return false;
+    }
+    if (has_pid_info) {
+        auto pid_info = std::make_unique<PIDInfo>();
+        uint8_t power_allocator;
+        if (!reader->read(&pid_info->target) || !reader->read(&pid_info->k_p) ||
+            !reader->read(&pid_info->k_i) || !reader->read(&pid_info->k_d) ||
+            !reader->read(&pid_info->i_max) || !reader->read(&pid_info->max_budget) ||
+            !reader->read(&pid_info->min_budget) ||
+            !reader->readStringVector(&pid_info->cdev_request) || !reader->read(&power_allocator) ||
+            !reader->readVector(&pid_info->cdev_weight) ||
+            pid_info->cdev_weight.size() != pid_info->cdev_request.size()) {
+            return false;
+        }
+        pid_info->power_allocator = power_allocator;
+        sensor_info->pid_info = std::move(pid_info);
+    }
+    return true;
+}
+
+// Map the blob and return the section at the header offset selected by section_offset, or an
+// empty view if the blob is missing, stale or invalid.
+class MappedBlob {
+  public:
+    MappedBlob(std::string_view blob_path, std::string_view json_doc) {
+        android::base::unique_fd fd(
+                TEMP_FAILURE_RETRY(open(blob_path.data(), O_RDONLY | O_CLOEXEC)));
+        if (fd < 0) {
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(BlobHeader)) {
+            LOG(ERROR) << "Invalid thermal config blob " << blob_path;
+            return;
+        }
+        void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            PLOG(ERROR) << "Failed to map thermal config blob " << blob_path;
+            return;
+        }
+        addr_ = addr;
+        size_ = st.st_size;
+
+        std::memcpy(&header_, addr_, sizeof(header_));
+        if (kBlobMagic != std::string_view(header_.magic, sizeof(header_.magic)) ||
+            header_.version != kBlobVersion || header_.sensors_offset > size_ ||
+            header_.cdevs_offset > size_) {
+            LOG(ERROR) << "Invalid thermal config blob header " << blob_path;
+            return;
+        }
+        if (header_.json_hash != HashConfigJson(json_doc)) {
+            LOG(WARNING) << "Stale thermal config blob " << blob_path << ", using JSON config";
+            return;
+        }
+        valid_ = true;
+    }
+    ~MappedBlob() {
+        if (addr_ != nullptr) {
+            munmap(addr_, size_);
+        }
+    }
+
+    // Disallow copy and assign.
+    MappedBlob(const MappedBlob &) = delete;
+    void operator=(const MappedBlob &) = delete;
+
+    bool isValid() const { return valid_; }
+    std::string_view getSection(uint32_t BlobHeader::*section_offset) const {
+        const uint32_t offset = header_.*section_offset;
+        return std::string_view(static_cast<const char *>(addr_) + offset, size_ - offset);
+    }
+
+  private:
+    void *addr_ = nullptr;
+    size_t size_ = 0;
+    BlobHeader header_;
+    bool valid_ = false;
+};
+
+}  // namespace
+
+std::string GetConfigBlobPath(std::string_view config_path) {
+    std::string blob_path(config_path);
+    if (blob_path.size() >= kJsonSuffix.size() &&
+        blob_path.compare(blob_path.size() - kJsonSuffix.size(), kJsonSuffix.size(),
+                          kJsonSuffix) == 0) {
+        blob_path.resize(blob_path.size() - kJsonSuffix.size());
+    }
+    return blob_path.append(kBlobSuffix);
+}
+
+// 64-bit FNV-1a, stable across the host compiler and the device.
+uint64_t HashConfigJson(std::string_view json_doc) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : json_doc) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+std::string SerializeThermalConfig(std::string_view json_doc,
+                                   const std::map<std::string, SensorInfo> &sensor_info_map,
+                                   const std::map<std::string, CdevInfo> &cooling_device_info_map) {
+    BlobHeader header = {};
+    std::memcpy(header.magic, kBlobMagic.data(), sizeof(header.magic));
+    header.version = kBlobVersion;
+    header.json_hash = HashConfigJson(json_doc);
+
+    BlobWriter writer;
+    writer.write(header);
+
+    header.sensors_offset = writer.size();
+    writer.write<uint32_t>(sensor_info_map.size());
+    for (const auto &name_info_pair : sensor_info_map) {
+        writer.writeString(name_info_pair.first);
+        writeSensorInfo(&writer, name_info_pair.second);
+    }
+
+    header.cdevs_offset = writer.size();
+    writer.write<uint32_t>(cooling_device_info_map.size());
+    for (const auto &name_info_pair : cooling_device_info_map) {
+        writer.writeString(name_info_pair.first);
+        writer.write(name_info_pair.second.type);
+        writer.writeVector(name_info_pair.second.state2power);
+        writer.writeString(name_info_pair.second.load_path);
+        writer.writeVector(name_info_pair.second.load_cpus);
+    }
+
+    // Now that the offsets are known, rewrite the header.
+    writer.data()->replace(0, sizeof(header), reinterpret_cast<const char *>(&header),
+                           sizeof(header));
+    return *writer.data();
+}
+
+std::string SerializeSensorInfo(const SensorInfo &sensor_info) {
+    BlobWriter writer;
+    writeSensorInfo(&writer, sensor_info);
+    return *writer.data();
+}
+
+bool ReadConfigBlob(std::string_view blob_path, std::string_view json_doc,
+                    std::map<std::string, SensorInfo> *sensor_info_map,
+                    std::map<std::string, CdevInfo> *cooling_device_info_map) {
+    MappedBlob blob(blob_path, json_doc);
+    if (!blob.isValid()) {
+        return false;
+    }
+
+    sensor_info_map->clear();
+    cooling_device_info_map->clear();
+    BlobReader sensor_reader(blob.getSection(&BlobHeader::sensors_offset));
+    uint32_t count;
+    if (!sensor_reader.read(&count)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        std::string name;
+        SensorInfo sensor_info;
+        if (!sensor_reader.readString(&name) || !readSensorInfo(&sensor_reader, &sensor_info)) {
+            LOG(ERROR) << "Invalid thermal config blob Sensor[" << i << "]";
+            sensor_info_map->clear();
+            return false;
+        }
+        (*sensor_info_map)[name] = std::move(sensor_info);
+    }
+
+    BlobReader cdev_reader(blob.getSection(&BlobHeader::cdevs_offset));
+    if (!cdev_reader.read(&count)) {
+        sensor_info_map->clear();
+        return false;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        std::string name;
+        CdevInfo cdev_info;
+        if (!cdev_reader.readString(&name) || !cdev_reader.read(&cdev_info.type) ||
+            !cdev_reader.readVector(&cdev_info.state2power) ||
+            !cdev_reader.readString(&cdev_info.load_path) ||
+            !cdev_reader.readVector(&cdev_info.load_cpus)) {
+            LOG(ERROR) << "Invalid thermal config blob CoolingDevice[" << i << "]";
+            sensor_info_map->clear();
+            cooling_device_info_map->clear();
+            return false;
+        }
+        (*cooling_device_info_map)[name] = std::move(cdev_info);
+    }
+
+    // The hash only proves which JSON the blob came from, not that it was written intact
+    if (!ValidateSensorInfo(*sensor_info_map) ||
+        !ValidateCoolingDevices(*cooling_device_info_map)) {
+        LOG(ERROR) << "Invalid thermal config blob " << blob_path << ", using JSON config";
+        sensor_info_map->clear();
+        cooling_device_info_map->clear();
+        return false;
+    }
+    LOG(INFO) << sensor_info_map->size() << " Sensors and " << cooling_device_info_map->size()
+              << " CoolingDevices loaded from " << blob_path;
+    return true;
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
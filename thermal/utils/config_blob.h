@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef THERMAL_UTILS_CONFIG_BLOB_H__
+#define THERMAL_UTILS_CONFIG_BLOB_H__
+
+#include <map>
+#include <string>
+#include <string_view>
+
+#include "config_parser.h"
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V2_0 {
+namespace implementation {
+
+// Binary form of the thermal JSON config, generated at build time by thermal_config_compiler.
+// The blob records a hash of the JSON it was compiled from, and is only used while it matches
+// the JSON installed next to it, so a stale blob falls back to JSON parsing.
+//
+// Layout, all values little-endian:
+//   header:  "THCF" magic, u32 version, u64 JSON hash, u32 sensors offset, u32 cdevs offset
+//   strings: u16 length followed by the characters
+//   arrays:  u32 count followed by the elements
+
+// Return the blob path installed next to a JSON config, e.g. thermal_info_config.json ->
+// thermal_info_config.bin
+std::string GetConfigBlobPath(std::string_view config_path);
+uint64_t HashConfigJson(std::string_view json_doc);
+
+std::string SerializeThermalConfig(std::string_view json_doc,
+                                   const std::map<std::string, SensorInfo> &sensor_info_map,
+                                   const std::map<std::string, CdevInfo> &cooling_device_info_map);
+// Serialize a single sensor in the blob format, two sensors are configured the same iff their
+// serialized forms are equal.
+std::string SerializeSensorInfo(const SensorInfo &sensor_info);
+
+// Fill the maps from the blob at blob_path if it was compiled from json_doc, mapping it once for
+// both. Return false, with both maps empty, when the blob is missing, stale or invalid.
+bool ReadConfigBlob(std::string_view blob_path, std::string_view json_doc,
+                    std::map<std::string, SensorInfo> *sensor_info_map,
+                    std::map<std::string, CdevInfo> *cooling_device_info_map);
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
+
+#endif  // THERMAL_UTILS_CONFIG_BLOB_H__
@@ -16,12 +16,15 @@
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/strings.h>
+#include <algorithm>
 #include <cmath>
+#include <functional>
 #include <set>
 
 #include <json/reader.h>
 #include <json/value.h>
 
+#include "config_blob.h"
 #include "config_parser.h"
 
 namespace android {
@@ -57,25 +60,170 @@ float getFloatFromValue(const Json::Value &value) {
     }
 }
 
-}  // namespace
+// Return false when failed parsing
+bool getFormulaFromString(std::string_view str, FormulaOption *out) {
+    if (str == "WEIGHTED_SUM") {
+        *out = FormulaOption::WEIGHTED_SUM;
+    } else if (str == "MAXIMUM") {
+        *out = FormulaOption::MAXIMUM;
+    } else if (str == "MINIMUM") {
+        *out = FormulaOption::MINIMUM;
+    } else {
+        return false;
+    }
+    return true;
+}
 
-std::map<std::string, SensorInfo> ParseSensorInfo(std::string_view config_path) {
-    std::string json_doc;
-    std::map<std::string, SensorInfo> sensors_parsed;
-    if (!android::base::ReadFileToString(config_path.data(), &json_doc)) {
-        LOG(ERROR) << "Failed to read JSON config from " << config_path;
-        return sensors_parsed;
+// Return nullptr when failed parsing. Linked sensors must be defined before the virtual sensor
+// in the config, which also keeps virtual sensors free of cycles.
+std::unique_ptr<VirtualSensorInfo> ParseVirtualSensorInfo(
+        std::string_view name, const Json::Value &sensor,
+        const std::map<std::string, SensorInfo> &sensors_parsed) {
+    FormulaOption formula;
+    std::string formula_str = sensor["Formula"].asString();
+    LOG(INFO) << "Sensor[" << name << "]'s Formula: " << formula_str;
+    if (!getFormulaFromString(formula_str, &formula)) {
+        LOG(ERROR) << "Invalid "
+                   << "Sensor[" << name << "]'s Formula: " << formula_str;
+        return nullptr;
     }
 
-    Json::Value root;
-    Json::Reader reader;
+    std::vector<std::string> linked_sensors;
+    Json::Value values = sensor["Combination"];
+    if (values.size() == 0) {
+        LOG(ERROR) << "Invalid "
+                   << "Sensor[" << name << "]'s Combination count " << values.size();
+        return nullptr;
+    }
+    for (Json::Value::ArrayIndex j = 0; j < values.size(); ++j) {
+        linked_sensors.emplace_back(values[j].asString());
+        if (!sensors_parsed.count(linked_sensors.back())) {
+            LOG(ERROR) << "Invalid "
+                       << "Sensor[" << name << "]'s Combination[" << j
+                       << "]: " << linked_sensors.back() << " is not defined before";
+            return nullptr;
+        }
+        LOG(INFO) << "Sensor[" << name << "]'s Combination[" << j
+                  << "]: " << linked_sensors.back();
+    }
 
-    if (!reader.parse(json_doc, root)) {
-        LOG(ERROR) << "Failed to parse JSON config";
-        return sensors_parsed;
+    std::vector<float> coefficients;
+    values = sensor["Coefficient"];
+    if (values.size() == 0) {
+        LOG(INFO) << "Cannot find valid "
+                  << "Sensor[" << name << "]'s Coefficient, default all to 1.0";
+        coefficients.assign(linked_sensors.size(), 1.0);
+    } else if (values.size() != linked_sensors.size()) {
+        LOG(ERROR) << "Invalid "
+                   << "Sensor[" << name << "]'s Coefficient count " << values.size();
+        return nullptr;
+    } else {
+        for (Json::Value::ArrayIndex j = 0; j < values.size(); ++j) {
+            coefficients.emplace_back(getFloatFromValue(values[j]));
+            if (std::isnan(coefficients.back())) {
+                LOG(ERROR) << "Invalid "
+                           << "Sensor[" << name << "]'s Coefficient[" << j
+                           << "]: " << coefficients.back();
+                return nullptr;
+            }
+            LOG(INFO) << "Sensor[" << name << "]'s Coefficient[" << j
+                      << "]: " << coefficients.back();
+        }
+    }
+
+    float offset = 0.0;
+    if (!sensor["Offset"].empty()) {
+        offset = getFloatFromValue(sensor["Offset"]);
+    }
+    LOG(INFO) << "Sensor[" << name << "]'s Offset: " << offset;
+
+    return std::make_unique<VirtualSensorInfo>(VirtualSensorInfo{
+            .linked_sensors = linked_sensors,
+            .coefficients = coefficients,
+            .offset = offset,
+            .formula = formula,
+    });
+}
+
+// Return nullptr when failed parsing
+std::unique_ptr<PIDInfo> ParsePIDInfo(std::string_view name, const Json::Value &pid) {
+    const std::array<std::pair<std::string_view, float PIDInfo::*>, 7> kPIDFloatFields = {{
+            {"Target", &PIDInfo::target},
+            {"K_P", &PIDInfo::k_p},
+            {"K_I", &PIDInfo::k_i},
+            {"K_D", &PIDInfo::k_d},
+            {"I_Max", &PIDInfo::i_max},
+            {"MaxBudget", &PIDInfo::max_budget},
+            {"MinBudget", &PIDInfo::min_budget},
+    }};
+
+    auto pid_info = std::make_unique<PIDInfo>();
+    for (const auto &field : kPIDFloatFields) {
+        const Json::Value &value = pid[field.first.data()];
+        if (value.empty()) {
+            LOG(ERROR) << "Failed to read "
+                       << "Sensor[" << name << "]'s PIDInfo " << field.first;
+            return nullptr;
+        }
+        pid_info.get()->*field.second = getFloatFromValue(value);
+        if (std::isnan(pid_info.get()->*field.second)) {
+            LOG(ERROR) << "Invalid "
+                       << "Sensor[" << name << "]'s PIDInfo " << field.first;
+            return nullptr;
+        }
+        LOG(INFO) << "Sensor[" << name << "]'s PIDInfo " << field.first << ": "
+                  << pid_info.get()->*field.second;
+    }
+
+    if (pid_info->i_max < 0 || pid_info->min_budget < 0 ||
+        pid_info->max_budget < pid_info->min_budget) {
+        LOG(ERROR) << "Invalid "
+                   << "Sensor[" << name << "]'s PIDInfo I_Max or budget range";
+        return nullptr;
+    }
+
+    Json::Value values = pid["CoolingDevices"];
+    if (values.size() == 0) {
+        LOG(ERROR) << "Invalid "
+                   << "Sensor[" << name << "]'s PIDInfo CoolingDevices count " << values.size();
+        return nullptr;
+    }
+    for (Json::Value::ArrayIndex j = 0; j < values.size(); ++j) {
+        pid_info->cdev_request.emplace_back(values[j].asString());
+        LOG(INFO) << "Sensor[" << name << "]'s PIDInfo CoolingDevices[" << j
+                  << "]: " << pid_info->cdev_request.back();
+    }
+
+    pid_info->power_allocator = pid["PowerAllocator"].isBool() && pid["PowerAllocator"].asBool();
+    LOG(INFO) << "Sensor[" << name << "]'s PIDInfo PowerAllocator: " << std::boolalpha
+              << pid_info->power_allocator << std::noboolalpha;
+
+    values = pid["CoolingDeviceWeights"];
+    if (values.empty()) {
+        pid_info->cdev_weight.assign(pid_info->cdev_request.size(), 1.0);
+    } else if (values.size() != pid_info->cdev_request.size()) {
+        LOG(ERROR) << "Invalid "
+                   << "Sensor[" << name << "]'s PIDInfo CoolingDeviceWeights count "
+                   << values.size();
+        return nullptr;
+    }
+    for (Json::Value::ArrayIndex j = 0; j < values.size(); ++j) {
+        pid_info->cdev_weight.emplace_back(getFloatFromValue(values[j]));
+        if (std::isnan(pid_info->cdev_weight[j]) || pid_info->cdev_weight[j] < 0) {
+            LOG(ERROR) << "Invalid "
+                       << "Sensor[" << name << "]'s PIDInfo CoolingDeviceWeights[" << j
+                       << "]: " << pid_info->cdev_weight[j];
+            return nullptr;
+        }
+        LOG(INFO) << "Sensor[" << name << "]'s PIDInfo CoolingDeviceWeights[" << j
+                  << "]: " << pid_info->cdev_weight[j];
     }
 
-    Json::Value sensors = root["Sensors"];
+    return pid_info;
+}
+
+std::map<std::string, SensorInfo> parseSensorInfo(const Json::Value &sensors) {
+    std::map<std::string, SensorInfo> sensors_parsed;
     std::size_t total_parsed = 0;
     std::set<std::string> sensors_name_parsed;
 
@@ -217,6 +365,37 @@ std::map<std::string, SensorInfo> ParseSensorInfo(std::string_view config_path)
         LOG(INFO) << "Sensor[" << name << "]'s Monitor: " << std::boolalpha << is_monitor
                   << std::noboolalpha;
 
+        std::chrono::milliseconds notification_interval(0);
+        if (!sensors[i]["NotificationInterval"].empty()) {
+            if (!sensors[i]["NotificationInterval"].isUInt()) {
+                LOG(ERROR) << "Invalid Sensor[" << name << "]'s NotificationInterval";
+                sensors_parsed.clear();
+                return sensors_parsed;
+            }
+            notification_interval =
+                    std::chrono::milliseconds(sensors[i]["NotificationInterval"].asUInt());
+        }
+        LOG(INFO) << "Sensor[" << name
+                  << "]'s NotificationInterval: " << notification_interval.count() << "ms";
+
+        std::unique_ptr<VirtualSensorInfo> virtual_sensor_info;
+        if (sensors[i]["VirtualSensor"].isBool() && sensors[i]["VirtualSensor"].asBool()) {
+            virtual_sensor_info = ParseVirtualSensorInfo(name, sensors[i], sensors_parsed);
+            if (!virtual_sensor_info) {
+                sensors_parsed.clear();
+                return sensors_parsed;
+            }
+        }
+
+        std::unique_ptr<PIDInfo> pid_info;
+        if (!sensors[i]["PIDInfo"].empty()) {
+            pid_info = ParsePIDInfo(name, sensors[i]["PIDInfo"]);
+            if (!pid_info) {
+                sensors_parsed.clear();
+                return sensors_parsed;
+            }
+        }
+
         sensors_parsed[name] = {
                 .type = sensor_type,
                 .hot_thresholds = hot_thresholds,
@@ -226,6 +405,9 @@ std::map<std::string, SensorInfo> ParseSensorInfo(std::string_view config_path)
                 .vr_threshold = vr_threshold,
                 .multiplier = multiplier,
                 .is_monitor = is_monitor,
+                .notification_interval = notification_interval,
+                .virtual_sensor_info = std::move(virtual_sensor_info),
+                .pid_info = std::move(pid_info),
         };
         ++total_parsed;
     }
@@ -234,23 +416,8 @@ std::map<std::string, SensorInfo> ParseSensorInfo(std::string_view config_path)
     return sensors_parsed;
 }
 
-std::map<std::string, CoolingType> ParseCoolingDevice(std::string_view config_path) {
-    std::string json_doc;
-    std::map<std::string, CoolingType> cooling_devices_parsed;
-    if (!android::base::ReadFileToString(config_path.data(), &json_doc)) {
-        LOG(ERROR) << "Failed to read JSON config from " << config_path;
-        return cooling_devices_parsed;
-    }
-
-    Json::Value root;
-    Json::Reader reader;
-
-    if (!reader.parse(json_doc, root)) {
-        LOG(ERROR) << "Failed to parse JSON config";
-        return cooling_devices_parsed;
-    }
-
-    Json::Value cooling_devices = root["CoolingDevices"];
+std::map<std::string, CdevInfo> parseCoolingDevice(const Json::Value &cooling_devices) {
+    std::map<std::string, CdevInfo> cooling_devices_parsed;
     std::size_t total_parsed = 0;
     std::set<std::string> cooling_devices_name_parsed;
 
@@ -282,7 +449,50 @@ std::map<std::string, CoolingType> ParseCoolingDevice(std::string_view config_pa
             return cooling_devices_parsed;
         }
 
-        cooling_devices_parsed[name] = cooling_device_type;
+        std::vector<float> state2power;
+        Json::Value values = cooling_devices[i]["State2Power"];
+        for (Json::Value::ArrayIndex j = 0; j < values.size(); ++j) {
+            state2power.emplace_back(getFloatFromValue(values[j]));
+            if (std::isnan(state2power[j]) || (j > 0 && state2power[j] > state2power[j - 1])) {
+                LOG(ERROR) << "Invalid "
+                           << "CoolingDevice[" << name << "]'s State2Power[" << j
+                           << "]: " << state2power[j];
+                cooling_devices_parsed.clear();
+                return cooling_devices_parsed;
+            }
+            LOG(INFO) << "CoolingDevice[" << name << "]'s State2Power[" << j
+                      << "]: " << state2power[j];
+        }
+
+        std::string load_path = cooling_devices[i]["LoadPath"].asString();
+        if (!load_path.empty()) {
+            LOG(INFO) << "CoolingDevice[" << name << "]'s LoadPath: " << load_path;
+        }
+        std::vector<uint32_t> load_cpus;
+        values = cooling_devices[i]["LoadCpus"];
+        for (Json::Value::ArrayIndex j = 0; j < values.size(); ++j) {
+            if (!values[j].isUInt()) {
+                LOG(ERROR) << "Invalid "
+                           << "CoolingDevice[" << name << "]'s LoadCpus[" << j << "]";
+                cooling_devices_parsed.clear();
+                return cooling_devices_parsed;
+            }
+            load_cpus.emplace_back(values[j].asUInt());
+            LOG(INFO) << "CoolingDevice[" << name << "]'s LoadCpus[" << j
+                      << "]: " << load_cpus[j];
+        }
+        if (!load_path.empty() && !load_cpus.empty()) {
+            LOG(ERROR) << "CoolingDevice[" << name << "] has both LoadPath and LoadCpus";
+            cooling_devices_parsed.clear();
+            return cooling_devices_parsed;
+        }
+
+        cooling_devices_parsed[name] = {
+                .type = cooling_device_type,
+                .state2power = state2power,
+                .load_path = load_path,
+                .load_cpus = load_cpus,
+        };
 
         ++total_parsed;
     }
@@ -291,6 +501,242 @@ std::map<std::string, CoolingType> ParseCoolingDevice(std::string_view config_pa
     return cooling_devices_parsed;
 }
 
+template <typename T>
+bool isValidEnum(T value) {
+    auto types = hidl_enum_range<T>();
+    return std::find(types.begin(), types.end(), value) != types.end();
+}
+
+// Whether the non NAN values are ordered by compare, e.g. hot thresholds rising with severity
+template <typename Compare>
+bool isOrdered(const ThrottlingArray &values, Compare compare) {
+    float prev = NAN;
+    for (float value : values) {
+        if (std::isnan(value)) {
+            continue;
+        }
+        if (!std::isnan(prev) && !compare(prev, value)) {
+            return false;
+        }
+        prev = value;
+    }
+    return true;
+}
+
+bool validateVirtualSensorInfo(std::string_view name, const VirtualSensorInfo &virtual_sensor_info,
+                               const std::map<std::string, SensorInfo> &sensor_info_map) {
+    if (virtual_sensor_info.formula > FormulaOption::MINIMUM) {
+        LOG(ERROR) << "Invalid "
+                   << "Sensor[" << name << "]'s Formula: " << virtual_sensor_info.formula;
+        return false;
+    }
+    if (virtual_sensor_info.linked_sensors.empty()) {
+        LOG(ERROR) << "Invalid "
+                   << "Sensor[" << name << "]'s Combination count 0";
+        return false;
+    }
+    if (virtual_sensor_info.coefficients.size() != virtual_sensor_info.linked_sensors.size()) {
+        LOG(ERROR) << "Invalid "
+                   << "Sensor[" << name << "]'s Coefficient count "
+                   << virtual_sensor_info.coefficients.size();
+        return false;
+    }
+    for (size_t j = 0; j < virtual_sensor_info.linked_sensors.size(); ++j) {
+        if (!sensor_info_map.count(virtual_sensor_info.linked_sensors[j])) {
+            LOG(ERROR) << "Invalid "
+                       << "Sensor[" << name << "]'s Combination[" << j
+                       << "]: " << virtual_sensor_info.linked_sensors[j] << " is not defined";
+            return false;
+        }
+        if (std::isnan(virtual_sensor_info.coefficients[j])) {
+            LOG(ERROR) << "Invalid "
+                       << "Sensor[" << name << "]'s Coefficient[" << j << "]";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool validatePIDInfo(std::string_view name, const PIDInfo &pid_info) {
+    for (float value : {pid_info.target, pid_info.k_p, pid_info.k_i, pid_info.k_d, pid_info.i_max,
+                        pid_info.max_budget, pid_info.min_budget}) {
+        if (std::isnan(value)) {
+            LOG(ERROR) << "Invalid "
+                       << "Sensor[" << name << "]'s PIDInfo";
+            return false;
+        }
+    }
+    if (pid_info.i_max < 0 || pid_info.min_budget < 0 ||
+        pid_info.max_budget < pid_info.min_budget) {
+        LOG(ERROR) << "Invalid "
+                   << "Sensor[" << name << "]'s PIDInfo I_Max or budget range";
+        return false;
+    }
+    if (pid_info.cdev_request.empty() ||
+        pid_info.cdev_weight.size() != pid_info.cdev_request.size()) {
+        LOG(ERROR) << "Invalid "
+                   << "Sensor[" << name << "]'s PIDInfo CoolingDevices count "
+                   << pid_info.cdev_request.size();
+        return false;
+    }
+    for (size_t j = 0; j < pid_info.cdev_weight.size(); ++j) {
+        if (std::isnan(pid_info.cdev_weight[j]) || pid_info.cdev_weight[j] < 0) {
+            LOG(ERROR) << "Invalid "
+                       << "Sensor[" << name << "]'s PIDInfo CoolingDeviceWeights[" << j
+                       << "]: " << pid_info.cdev_weight[j];
+            return false;
+        }
+    }
+    return true;
+}
+
+// Return false when the virtual sensor name depends on itself. visiting holds the sensors on the
+// current path, checked the ones already known to be free of cycles.
+bool checkVirtualSensorLinks(const std::string &name,
+                             const std::map<std::string, SensorInfo> &sensor_info_map,
+                             std::set<std::string> *visiting, std::set<std::string> *checked) {
+    if (checked->count(name)) {
+        return true;
+    }
+    if (!visiting->insert(name).second) {
+        LOG(ERROR) << "Invalid "
+                   << "Sensor[" << name << "]: virtual sensor cycle";
+        return false;
+    }
+    const auto &virtual_sensor_info = sensor_info_map.at(name).virtual_sensor_info;
+    if (virtual_sensor_info != nullptr) {
+        for (const auto &linked_sensor : virtual_sensor_info->linked_sensors) {
+            if (!checkVirtualSensorLinks(linked_sensor, sensor_info_map, visiting, checked)) {
+                return false;
+            }
+        }
+    }
+    visiting->erase(name);
+    checked->insert(name);
+    return true;
+}
+
+}  // namespace
+
+void ParseThermalConfig(std::string_view config_path,
+                        std::map<std::string, SensorInfo> *sensor_info_map,
+                        std::map<std::string, CdevInfo> *cooling_device_info_map) {
+    std::string json_doc;
+    sensor_info_map->clear();
+    cooling_device_info_map->clear();
+    if (!android::base::ReadFileToString(config_path.data(), &json_doc)) {
+        LOG(ERROR) << "Failed to read JSON config from " << config_path;
+        return;
+    }
+
+    if (ReadConfigBlob(GetConfigBlobPath(config_path), json_doc, sensor_info_map,
+                       cooling_device_info_map)) {
+        return;
+    }
+
+    Json::Value root;
+    Json::Reader reader;
+
+    if (!reader.parse(json_doc, root)) {
+        LOG(ERROR) << "Failed to parse JSON config";
+        return;
+    }
+
+    *sensor_info_map = parseSensorInfo(root["Sensors"]);
+    *cooling_device_info_map = parseCoolingDevice(root["CoolingDevices"]);
+}
+
+bool ValidateSensorInfo(const std::map<std::string, SensorInfo> &sensor_info_map) {
+    for (const auto &name_info_pair : sensor_info_map) {
+        const std::string &name = name_info_pair.first;
+        const SensorInfo &sensor_info = name_info_pair.second;
+        if (name.empty() || !isValidEnum(sensor_info.type)) {
+            LOG(ERROR) << "Invalid "
+                       << "Sensor[" << name << "]'s Name or Type";
+            return false;
+        }
+        if (!isOrdered(sensor_info.hot_thresholds, std::less_equal<float>()) ||
+            !isOrdered(sensor_info.cold_thresholds, std::greater_equal<float>())) {
+            LOG(ERROR) << "Invalid "
+                       << "Sensor[" << name << "]'s HotThreshold or ColdThreshold order";
+            return false;
+        }
+        for (size_t j = 0; j < kThrottlingSeverityCount; ++j) {
+            if (std::isnan(sensor_info.hot_hysteresis[j]) ||
+                std::isnan(sensor_info.cold_hysteresis[j])) {
+                LOG(ERROR) << "Invalid "
+                           << "Sensor[" << name << "]'s HotHysteresis or ColdHysteresis[" << j
+                           << "]";
+                return false;
+            }
+        }
+        if (sensor_info.virtual_sensor_info != nullptr &&
+            !validateVirtualSensorInfo(name, *sensor_info.virtual_sensor_info, sensor_info_map)) {
+            return false;
+        }
+        if (sensor_info.pid_info != nullptr && !validatePIDInfo(name, *sensor_info.pid_info)) {
+            return false;
+        }
+    }
+
+    // Linked sensors are all defined now, make sure they do not loop
+    std::set<std::string> visiting, checked;
+    for (const auto &name_info_pair : sensor_info_map) {
+        if (!checkVirtualSensorLinks(name_info_pair.first, sensor_info_map, &visiting, &checked)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ValidateCoolingDevices(const std::map<std::string, CdevInfo> &cooling_device_info_map) {
+    for (const auto &name_info_pair : cooling_device_info_map) {
+        const std::string &name = name_info_pair.first;
+        const CdevInfo &cdev_info = name_info_pair.second;
+        if (name.empty() || !isValidEnum(cdev_info.type)) {
+            LOG(ERROR) << "Invalid "
+                       << "CoolingDevice[" << name << "]'s Name or Type";
+            return false;
+        }
+        for (size_t j = 0; j < cdev_info.state2power.size(); ++j) {
+            if (std::isnan(cdev_info.state2power[j]) ||
+                (j > 0 && cdev_info.state2power[j] > cdev_info.state2power[j - 1])) {
+                LOG(ERROR) << "Invalid "
+                           << "CoolingDevice[" << name << "]'s State2Power[" << j
+                           << "]: " << cdev_info.state2power[j];
+                return false;
+            }
+        }
+        if (!cdev_info.load_path.empty() && !cdev_info.load_cpus.empty()) {
+            LOG(ERROR) << "CoolingDevice[" << name << "] has both LoadPath and LoadCpus";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ValidatePIDCoolingDevices(const std::map<std::string, SensorInfo> &sensor_info_map,
+                               const std::map<std::string, CdevInfo> &cooling_device_info_map) {
+    for (const auto &sensor_info : sensor_info_map) {
+        if (sensor_info.second.pid_info == nullptr) {
+            continue;
+        }
+        for (const auto &cdev_name : sensor_info.second.pid_info->cdev_request) {
+            if (!cooling_device_info_map.count(cdev_name)) {
+                LOG(ERROR) << sensor_info.first << ": PID cooling device " << cdev_name
+                           << " is not defined";
+                return false;
+            }
+            if (cooling_device_info_map.at(cdev_name).state2power.empty()) {
+                LOG(ERROR) << sensor_info.first << ": PID cooling device " << cdev_name
+                           << " has no State2Power";
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
 }  // namespace implementation
 }  // namespace V2_0
 }  // namespace thermal
@@ -17,8 +17,11 @@
 #ifndef THERMAL_UTILS_CONFIG_PARSER_H__
 #define THERMAL_UTILS_CONFIG_PARSER_H__
 
+#include <chrono>
 #include <map>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include <android/hardware/thermal/2.0/IThermal.h>
 
@@ -36,6 +39,40 @@ constexpr size_t kThrottlingSeverityCount = std::distance(
     hidl_enum_range<ThrottlingSeverity>().begin(), hidl_enum_range<ThrottlingSeverity>().end());
 using ThrottlingArray = std::array<float, static_cast<size_t>(kThrottlingSeverityCount)>;
 
+enum FormulaOption : uint32_t {
+    WEIGHTED_SUM = 0,
+    MAXIMUM,
+    MINIMUM,
+};
+
+// A virtual sensor is computed from other sensors instead of being read from sysfs:
+// value = formula(coefficients[i] * value(linked_sensors[i])) + offset
+struct VirtualSensorInfo {
+    std::vector<std::string> linked_sensors;
+    std::vector<float> coefficients;
+    float offset;
+    FormulaOption formula;
+};
+
+// Closed-loop power budget controller of a sensor, evaluated on the watcher thread:
+// budget = max_budget + k_p * err + integral(k_i * err) + k_d * d(err)/dt, err = target - temp
+struct PIDInfo {
+    float target;
+    float k_p;
+    float k_i;
+    float k_d;
+    // Limit of the accumulated integral term
+    float i_max;
+    float max_budget;
+    float min_budget;
+    // Cooling devices throttled to fit in the budget
+    std::vector<std::string> cdev_request;
+    // Split the budget across cdev_request by weighted demand instead of evenly
+    bool power_allocator;
+    // Weight of each cooling device of cdev_request in the power allocation
+    std::vector<float> cdev_weight;
+};
+
 struct SensorInfo {
     TemperatureType_2_0 type;
     ThrottlingArray hot_thresholds;
@@ -45,10 +82,35 @@ struct SensorInfo {
     float vr_threshold;
     float multiplier;
     bool is_monitor;
+    // Minimum time between two notifications of the sensor, severity changes within the interval
+    // are coalesced into the latest one.
+    std::chrono::milliseconds notification_interval;
+    std::unique_ptr<VirtualSensorInfo> virtual_sensor_info;
+    std::unique_ptr<PIDInfo> pid_info;
+};
+
+struct CdevInfo {
+    CoolingType type;
+    // Power consumption in mW of each state, from state 0 to max_state
+    std::vector<float> state2power;
+    // Load of the device for power allocation, either a sysfs node holding a percentage such as
+    // a devfreq load, or the busy time of the given cpus in /proc/stat. Fully loaded if neither.
+    std::string load_path;
+    std::vector<uint32_t> load_cpus;
 };
 
-std::map<std::string, SensorInfo> ParseSensorInfo(std::string_view config_path);
-std::map<std::string, CoolingType> ParseCoolingDevice(std::string_view config_path);
+// Parse the sensors and cooling devices of the config, from its compiled blob when that is up to
+// date. Each map is left empty when any of its entries is invalid.
+void ParseThermalConfig(std::string_view config_path,
+                        std::map<std::string, SensorInfo> *sensor_info_map,
+                        std::map<std::string, CdevInfo> *cooling_device_info_map);
+// Check parsed entries hold the invariants the JSON parser enforces, for configs loaded from a
+// blob: ordered thresholds, defined linked sensors without cycles, sane PID ranges, ...
+bool ValidateSensorInfo(const std::map<std::string, SensorInfo> &sensor_info_map);
+bool ValidateCoolingDevices(const std::map<std::string, CdevInfo> &cooling_device_info_map);
+// Check the cooling devices used by PID controllers are defined with State2Power.
+bool ValidatePIDCoolingDevices(const std::map<std::string, SensorInfo> &sensor_info_map,
+                               const std::map<std::string, CdevInfo> &cooling_device_info_map);
 
 }  // namespace implementation
 }  // namespace V2_0
@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <fcntl.h>
+#include <unistd.h>
 #include <algorithm>
 #include <string_view>
 
@@ -28,6 +30,13 @@ namespace thermal {
 namespace V2_0 {
 namespace implementation {
 
+namespace {
+
+// Thermal sysfs values are short numbers or names.
+constexpr size_t kMaxThermalFileSize = 128;
+
+}  // namespace
+
 std::string ThermalFiles::getThermalFilePath(std::string_view thermal_name) const {
     auto sensor_itr = thermal_name_to_path_map_.find(thermal_name.data());
     if (sensor_itr == thermal_name_to_path_map_.end()) {
@@ -37,17 +46,41 @@ std::string ThermalFiles::getThermalFilePath(std::string_view thermal_name) cons
 }
 
 bool ThermalFiles::addThermalFile(std::string_view thermal_name, std::string_view path) {
-    return thermal_name_to_path_map_.emplace(thermal_name, path).second;
+    if (!thermal_name_to_path_map_.emplace(thermal_name, path).second) {
+        return false;
+    }
+    android::base::unique_fd fd(
+            TEMP_FAILURE_RETRY(open(std::string(path).c_str(), O_RDONLY | O_CLOEXEC)));
+    if (fd < 0) {
+        PLOG(WARNING) << "Failed to open " << path << ", it will be reopened on every read";
+    } else {
+        thermal_name_to_fd_map_.emplace(thermal_name, std::move(fd));
+    }
+    return true;
 }
 
 bool ThermalFiles::readThermalFile(std::string_view thermal_name, std::string *data) const {
     std::string sensor_reading;
-    std::string file_path = getThermalFilePath(std::string_view(thermal_name));
     *data = "";
+    auto fd_itr = thermal_name_to_fd_map_.find(thermal_name.data());
+    if (fd_itr != thermal_name_to_fd_map_.end()) {
+        char buf[kMaxThermalFileSize];
+        // sysfs regenerates the value on every read at offset 0.
+        ssize_t size = TEMP_FAILURE_RETRY(pread(fd_itr->second.get(), buf, sizeof(buf), 0));
+        num_reads_.fetch_add(1, std::memory_order_relaxed);
+        if (size >= 0) {
+            *data = ::android::base::Trim(std::string(buf, size));
+            return true;
+        }
+        PLOG(WARNING) << "Failed to pread sensor: " << thermal_name;
+    }
+
+    std::string file_path = getThermalFilePath(std::string_view(thermal_name));
     if (file_path.empty()) {
         return false;
     }
 
+    num_reads_.fetch_add(1, std::memory_order_relaxed);
     if (!::android::base::ReadFileToString(file_path, &sensor_reading)) {
         PLOG(WARNING) << "Failed to read sensor: " << thermal_name;
         return false;
@@ -58,6 +91,19 @@ bool ThermalFiles::readThermalFile(std::string_view thermal_name, std::string *d
     return true;
 }
 
+bool ThermalFiles::writeThermalFile(std::string_view thermal_name, std::string_view data) const {
+    std::string file_path = getThermalFilePath(thermal_name);
+    if (file_path.empty()) {
+        return false;
+    }
+
+    if (!::android::base::WriteStringToFile(std::string(data), file_path)) {
+        PLOG(WARNING) << "Failed to write " << thermal_name << ": " << data;
+        return false;
+    }
+    return true;
+}
+
 }  // namespace implementation
 }  // namespace V2_0
 }  // namespace thermal
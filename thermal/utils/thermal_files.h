@@ -17,9 +17,12 @@
 #ifndef THERMAL_UTILS_THERMAL_FILES_H_
 #define THERMAL_UTILS_THERMAL_FILES_H_
 
+#include <atomic>
 #include <string>
 #include <unordered_map>
 
+#include <android-base/unique_fd.h>
+
 namespace android {
 namespace hardware {
 namespace thermal {
@@ -34,16 +37,24 @@ class ThermalFiles {
     void operator=(const ThermalFiles &) = delete;
 
     std::string getThermalFilePath(std::string_view thermal_name) const;
-    // Returns true if add was successful, false otherwise.
+    // Returns true if add was successful, false otherwise. The file is kept open so reads are a
+    // single pread(), if it cannot be opened reads fall back to reopening the path.
     bool addThermalFile(std::string_view thermal_name, std::string_view path);
     // If thermal_name is not found in the thermal names to path map, this will set
     // data to empty and return false. If the thermal_name is found and its content
     // is read, this function will fill in data accordingly then return true.
     bool readThermalFile(std::string_view thermal_name, std::string *data) const;
+    // Write data to the file of thermal_name, return false if thermal_name is not found or the
+    // write fails.
+    bool writeThermalFile(std::string_view thermal_name, std::string_view data) const;
     size_t getNumThermalFiles() const { return thermal_name_to_path_map_.size(); }
+    // Number of files read by readThermalFile() so far.
+    uint64_t getNumReads() const { return num_reads_.load(std::memory_order_relaxed); }
 
   private:
     std::unordered_map<std::string, std::string> thermal_name_to_path_map_;
+    std::unordered_map<std::string, android::base::unique_fd> thermal_name_to_fd_map_;
+    mutable std::atomic<uint64_t> num_reads_{0};
 };
 
 }  // namespace implementation
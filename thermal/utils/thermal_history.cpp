@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "thermal_history.h"
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V2_0 {
+namespace implementation {
+
+namespace {
+
+constexpr char kHistoryMagic[] = "THST";
+constexpr uint32_t kHistoryVersion = 1;
+
+template <typename T>
+void appendValue(std::string *out, T value) {
+    out->append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+}  // namespace
+
+void SensorHistory::record(int64_t timestamp_ms, float value, ThrottlingSeverity severity) {
+    const uint64_t count = count_.load(std::memory_order_relaxed);
+    if (count > 0) {
+        const uint32_t last_severity = last_severity_.load(std::memory_order_relaxed);
+        time_in_severity_ms_[last_severity].fetch_add(
+                timestamp_ms - last_timestamp_ms_.load(std::memory_order_relaxed),
+                std::memory_order_relaxed);
+    }
+    last_timestamp_ms_.store(timestamp_ms, std::memory_order_relaxed);
+    last_severity_.store(static_cast<uint32_t>(severity), std::memory_order_relaxed);
+
+    const uint32_t seq = seq_.load(std::memory_order_relaxed);
+    seq_.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    Slot &slot = slots_[count % kSensorHistorySize];
+    slot.timestamp_ms.store(timestamp_ms, std::memory_order_relaxed);
+    slot.value.store(value, std::memory_order_relaxed);
+    slot.severity.store(static_cast<uint32_t>(severity), std::memory_order_relaxed);
+    count_.store(count + 1, std::memory_order_relaxed);
+
+    seq_.store(seq + 2, std::memory_order_release);
+}
+
+std::vector<HistoryRecord> SensorHistory::getRecords() const {
+    std::vector<HistoryRecord> records;
+    while (true) {
+        const uint32_t seq = seq_.load(std::memory_order_acquire);
+        if (seq & 1) {
+            continue;
+        }
+
+        const uint64_t count = count_.load(std::memory_order_relaxed);
+        const size_t size = std::min<uint64_t>(count, kSensorHistorySize);
+        records.resize(size);
+        for (size_t i = 0; i < size; ++i) {
+            const Slot &slot = slots_[(count - size + i) % kSensorHistorySize];
+            records[i] = {
+                    .timestamp_ms = slot.timestamp_ms.load(std::memory_order_relaxed),
+                    .value = slot.value.load(std::memory_order_relaxed),
+                    .severity = static_cast<ThrottlingSeverity>(
+                            slot.severity.load(std::memory_order_relaxed)),
+            };
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq_.load(std::memory_order_relaxed) == seq) {
+            return records;
+        }
+    }
+}
+
+std::array<int64_t, kThrottlingSeverityCount> SensorHistory::getTimeInSeverityMs(
+        int64_t now_ms) const {
+    std::array<int64_t, kThrottlingSeverityCount> time_in_severity_ms;
+    for (size_t i = 0; i < kThrottlingSeverityCount; ++i) {
+        time_in_severity_ms[i] = time_in_severity_ms_[i].load(std::memory_order_relaxed);
+    }
+    // Account the ongoing interval since the last record.
+    if (count_.load(std::memory_order_relaxed) > 0) {
+        const int64_t last_timestamp_ms = last_timestamp_ms_.load(std::memory_order_relaxed);
+        if (now_ms > last_timestamp_ms) {
+            time_in_severity_ms[last_severity_.load(std::memory_order_relaxed)] +=
+                    now_ms - last_timestamp_ms;
+        }
+    }
+    return time_in_severity_ms;
+}
+
+HistoryStats SensorHistory::getStats(const std::vector<HistoryRecord> &records) {
+    HistoryStats stats = {
+            .count = records.size(),
+            .min = NAN,
+            .max = NAN,
+            .avg = NAN,
+    };
+    if (records.empty()) {
+        return stats;
+    }
+
+    float sum = 0.0;
+    stats.min = records.front().value;
+    stats.max = records.front().value;
+    for (const auto &record : records) {
+        stats.min = std::min(stats.min, record.value);
+        stats.max = std::max(stats.max, record.value);
+        sum += record.value;
+    }
+    stats.avg = sum / records.size();
+    return stats;
+}
+
+std::string SerializeSensorHistory(const std::map<std::string, SensorHistory> &history_map,
+                                   int64_t now_ms) {
+    std::string out(kHistoryMagic, sizeof(kHistoryMagic) - 1);
+    appendValue<uint32_t>(&out, kHistoryVersion);
+    appendValue<uint32_t>(&out, history_map.size());
+
+    for (const auto &name_history_pair : history_map) {
+        appendValue<uint16_t>(&out, name_history_pair.first.size());
+        out.append(name_history_pair.first);
+
+        appendValue<uint32_t>(&out, kThrottlingSeverityCount);
+        for (int64_t time_ms : name_history_pair.second.getTimeInSeverityMs(now_ms)) {
+            appendValue<int64_t>(&out, time_ms);
+        }
+
+        const auto records = name_history_pair.second.getRecords();
+        appendValue<uint32_t>(&out, records.size());
+        for (const auto &record : records) {
+            appendValue<int64_t>(&out, record.timestamp_ms);
+            appendValue<float>(&out, record.value);
+            appendValue<uint8_t>(&out, static_cast<uint8_t>(record.severity));
+        }
+    }
+    return out;
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
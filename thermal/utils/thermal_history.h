@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef THERMAL_UTILS_THERMAL_HISTORY_H_
+#define THERMAL_UTILS_THERMAL_HISTORY_H_
+
+#include <array>
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "config_parser.h"
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V2_0 {
+namespace implementation {
+
+// The history holds the last kSensorHistorySize samples of each sensor, not a fixed time window:
+// 10 minutes at the 2s polling interval, but much longer in uevent mode where a sensor is only
+// sampled on its uevents.
+constexpr size_t kSensorHistorySize = 300;
+
+struct HistoryRecord {
+    // Time on the ThermalHelper clock, the steady clock on device.
+    int64_t timestamp_ms;
+    float value;
+    ThrottlingSeverity severity;
+};
+
+struct HistoryStats {
+    size_t count;
+    float min;
+    float max;
+    float avg;
+};
+
+// Fixed-size history of the readings of one sensor. record() must only be called from a single
+// thread (the watcher thread) and never blocks; readers retry on a concurrent write instead of
+// taking a lock.
+class SensorHistory {
+  public:
+    SensorHistory() = default;
+    ~SensorHistory() = default;
+
+    // Disallow copy and assign.
+    SensorHistory(const SensorHistory &) = delete;
+    void operator=(const SensorHistory &) = delete;
+
+    void record(int64_t timestamp_ms, float value, ThrottlingSeverity severity);
+    // Return the records in the window, oldest first.
+    std::vector<HistoryRecord> getRecords() const;
+    // Return the time spent in each severity since the first record, up to now_ms.
+    std::array<int64_t, kThrottlingSeverityCount> getTimeInSeverityMs(int64_t now_ms) const;
+
+    static HistoryStats getStats(const std::vector<HistoryRecord> &records);
+
+  private:
+    struct Slot {
+        std::atomic<int64_t> timestamp_ms;
+        std::atomic<float> value;
+        std::atomic<uint32_t> severity;
+    };
+
+    std::array<Slot, kSensorHistorySize> slots_;
+    // Total number of records, the next record goes to slots_[count_ % kSensorHistorySize].
+    std::atomic<uint64_t> count_{0};
+    // Odd while record() is updating slots_.
+    std::atomic<uint32_t> seq_{0};
+    std::array<std::atomic<int64_t>, kThrottlingSeverityCount> time_in_severity_ms_{};
+    std::atomic<int64_t> last_timestamp_ms_{0};
+    std::atomic<uint32_t> last_severity_{0};
+};
+
+// Serialize the history of all sensors in a compact little-endian format for tools:
+//   header:  "THST" magic, u32 version, u32 sensor count
+//   sensor:  u16 name length, name, u32 severity count, i64 time in each severity (ms),
+//            u32 record count, records of {i64 timestamp_ms, f32 value, u8 severity}
+std::string SerializeSensorHistory(const std::map<std::string, SensorHistory> &history_map,
+                                   int64_t now_ms);
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
+
+#endif  // THERMAL_UTILS_THERMAL_HISTORY_H_
@@ -15,9 +15,14 @@
  */
 #include <cutils/uevent.h>
 #include <dirent.h>
+#include <linux/filter.h>
+#include <sys/epoll.h>
 #include <sys/inotify.h>
 #include <sys/resource.h>
+#include <sys/socket.h>
 #include <sys/types.h>
+#include <algorithm>
+#include <array>
 #include <chrono>
 #include <fstream>
 
@@ -35,22 +40,97 @@ namespace implementation {
 
 using std::chrono_literals::operator""ms;
 
+namespace {
+
+// Kernel uevents carry no netlink header, the payload starts with "action@devpath". Thermal zone
+// notifications are always "change" events of /devices/virtual/thermal/thermal_zoneN.
+// cur_state holds a small integer.
+constexpr size_t kCdevStateMaxSize = 32;
+
+constexpr char kThermalUeventPrefix[] = "change@/devices/virtual/thermal/";
+constexpr size_t kThermalUeventPrefixWords = (sizeof(kThermalUeventPrefix) - 1) / sizeof(uint32_t);
+static_assert((sizeof(kThermalUeventPrefix) - 1) % sizeof(uint32_t) == 0,
+              "prefix must be compared in whole words");
+
+// BPF_LD | BPF_W | BPF_ABS loads in network byte order.
+constexpr uint32_t prefixWord(size_t index) {
+    const char *word = kThermalUeventPrefix + index * sizeof(uint32_t);
+    return (static_cast<uint32_t>(static_cast<uint8_t>(word[0])) << 24) |
+           (static_cast<uint32_t>(static_cast<uint8_t>(word[1])) << 16) |
+           (static_cast<uint32_t>(static_cast<uint8_t>(word[2])) << 8) |
+           static_cast<uint32_t>(static_cast<uint8_t>(word[3]));
+}
+
+// Attach a classic BPF filter dropping every uevent but thermal zone changes in the kernel, so
+// the watcher thread is not woken up for other subsystems. parseUevent still checks SUBSYSTEM
+// in case this fails.
+bool attachThermalUeventFilter(int fd) {
+    std::array<sock_filter, kThermalUeventPrefixWords * 2 + 2> filter;
+    size_t pc = 0;
+    for (size_t i = 0; i < kThermalUeventPrefixWords; ++i) {
+        filter[pc++] =
+                BPF_STMT(BPF_LD | BPF_W | BPF_ABS, static_cast<uint32_t>(i * sizeof(uint32_t)));
+        // On mismatch jump to the reject instruction at the end of the program.
+        filter[pc] = BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, prefixWord(i), 0,
+                              static_cast<uint8_t>(filter.size() - pc - 2));
+        ++pc;
+    }
+    filter[pc++] = BPF_STMT(BPF_RET | BPF_K, 0xffffffff);
+    filter[pc++] = BPF_STMT(BPF_RET | BPF_K, 0);
+
+    const sock_fprog fprog = {
+            .len = static_cast<unsigned short>(filter.size()),
+            .filter = filter.data(),
+    };
+    return setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) == 0;
+}
+
+}  // namespace
+
 void ThermalWatcher::registerFilesToWatch(const std::set<std::string> &sensors_to_watch,
-                                          const std::set<std::string> &cdev_to_watch,
+                                          const std::map<std::string, std::string> &cdev_to_watch,
                                           bool uevent_monitor) {
     int flags = O_RDONLY | O_CLOEXEC | O_BINARY;
 
-    for (const auto &path : cdev_to_watch) {
+    if (!cdev_to_watch.empty()) {
+        cdev_epoll_fd_.reset(epoll_create1(EPOLL_CLOEXEC));
+        if (cdev_epoll_fd_ < 0) {
+            PLOG(ERROR) << "failed to create cooling device epoll set";
+        }
+    }
+    for (const auto &name_path_pair : cdev_to_watch) {
+        if (cdev_epoll_fd_ < 0) {
+            break;
+        }
+        const std::string &path = name_path_pair.second;
         android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), flags)));
         if (fd == -1) {
             PLOG(ERROR) << "failed to watch: " << path;
             continue;
         }
-        watch_to_file_path_map_.emplace(fd.get(), path);
+        // Read once, so only later sysfs_notify() calls raise EPOLLPRI.
+        char buf[kCdevStateMaxSize];
+        TEMP_FAILURE_RETRY(pread(fd.get(), buf, sizeof(buf), 0));
+        epoll_event event = {};
+        event.events = EPOLLPRI;
+        event.data.fd = fd.get();
+        if (epoll_ctl(cdev_epoll_fd_.get(), EPOLL_CTL_ADD, fd.get(), &event) != 0) {
+            PLOG(ERROR) << "failed to watch: " << path;
+            continue;
+        }
+        cdev_fd_to_name_map_.emplace(fd.get(), name_path_pair.first);
         fds_.emplace_back(std::move(fd));
-        looper_->addFd(fd.get(), 0, Looper::EVENT_INPUT, nullptr, nullptr);
+    }
+    if (!cdev_fd_to_name_map_.empty()) {
+        looper_->addFd(cdev_epoll_fd_.get(), 0, Looper::EVENT_INPUT, nullptr, nullptr);
     }
     monitored_sensors_.insert(sensors_to_watch.begin(), sensors_to_watch.end());
+    // Views into monitored_sensors_, whose nodes are stable, for lookups from the uevent buffer.
+    for (const auto &name : monitored_sensors_) {
+        if (!name.empty()) {
+            monitored_sensor_names_.emplace(name);
+        }
+    }
     if (!uevent_monitor) {
         is_polling_ = true;
         return;
@@ -64,6 +144,10 @@ void ThermalWatcher::registerFilesToWatch(const std::set<std::string> &sensors_t
 
     fcntl(uevent_fd_, F_SETFL, O_NONBLOCK);
 
+    if (!attachThermalUeventFilter(uevent_fd_.get())) {
+        PLOG(WARNING) << "failed to attach thermal uevent filter, filtering in userspace";
+    }
+
     looper_->addFd(uevent_fd_.get(), 0, Looper::EVENT_INPUT, nullptr, nullptr);
     is_polling_ = false;
     thermal_triggered_ = true;
@@ -71,6 +155,7 @@ void ThermalWatcher::registerFilesToWatch(const std::set<std::string> &sensors_t
 
 bool ThermalWatcher::startWatchingDeviceFiles() {
     if (cb_) {
+        last_update_time_ = std::chrono::steady_clock::now();
         auto ret = this->run("FileWatcherThread", PRIORITY_HIGHEST);
         if (ret != NO_ERROR) {
             LOG(ERROR) << "ThermalWatcherThread start fail";
@@ -83,10 +168,11 @@ bool ThermalWatcher::startWatchingDeviceFiles() {
     return false;
 }
 void ThermalWatcher::parseUevent(std::set<std::string> *sensors_set) {
-    bool thermal_event = false;
     constexpr int kUeventMsgLen = 2048;
+    constexpr std::string_view kSubsystemKey("SUBSYSTEM=");
+    constexpr std::string_view kThermalSubsystem("SUBSYSTEM=thermal");
+    constexpr std::string_view kNameKey("NAME=");
     char msg[kUeventMsgLen + 2];
-    char *cp;
 
     while (true) {
         int n = uevent_kernel_multicast_recv(uevent_fd_.get(), msg, kUeventMsgLen);
@@ -105,35 +191,46 @@ void ThermalWatcher::parseUevent(std::set<std::string> *sensors_set) {
         msg[n] = '\0';
         msg[n + 1] = '\0';
 
-        cp = msg;
-        while (*cp) {
-            std::string uevent = cp;
+        // Walk the NUL separated key=value tokens in place.
+        bool thermal_event = false;
+        for (const char *cp = msg; *cp;) {
+            std::string_view uevent(cp);
+            cp += uevent.size() + 1;
             if (!thermal_event) {
-                if (uevent.find("SUBSYSTEM=") == 0) {
-                    if (uevent.find("SUBSYSTEM=thermal") != std::string::npos) {
-                        thermal_event = true;
-                    } else {
+                if (uevent.substr(0, kSubsystemKey.size()) == kSubsystemKey) {
+                    if (uevent.substr(0, kThermalSubsystem.size()) != kThermalSubsystem) {
                         break;
                     }
+                    thermal_event = true;
                 }
-            } else {
-                auto start_pos = uevent.find("NAME=");
-                if (start_pos != std::string::npos) {
-                    start_pos += 5;
-                    std::string name = uevent.substr(start_pos);
-                    if (std::find(monitored_sensors_.begin(), monitored_sensors_.end(), name) !=
-                        monitored_sensors_.end()) {
-                        sensors_set->insert(name);
-                    }
-                    break;
+            } else if (uevent.substr(0, kNameKey.size()) == kNameKey) {
+                uevent.remove_prefix(kNameKey.size());
+                if (monitored_sensor_names_.count(uevent)) {
+                    sensors_set->emplace(uevent);
                 }
-            }
-            while (*cp++) {
+                break;
             }
         }
     }
 }
 
+void ThermalWatcher::parseCdevEvents(std::map<std::string, std::string> *cdev_states) {
+    std::array<epoll_event, 16> events;
+    // Level triggered, devices left over are reported on the next looper wake up.
+    int n = TEMP_FAILURE_RETRY(epoll_wait(cdev_epoll_fd_.get(), events.data(), events.size(), 0));
+    for (int i = 0; i < n; ++i) {
+        const int fd = events[i].data.fd;
+        char buf[kCdevStateMaxSize];
+        ssize_t size = TEMP_FAILURE_RETRY(pread(fd, buf, sizeof(buf), 0));
+        if (size < 0) {
+            PLOG(ERROR) << "failed to read cooling device " << cdev_fd_to_name_map_.at(fd);
+            continue;
+        }
+        (*cdev_states)[cdev_fd_to_name_map_.at(fd)] =
+                android::base::Trim(std::string(buf, size));
+    }
+}
+
 void ThermalWatcher::wake() {
     looper_->wake();
 }
@@ -148,7 +245,18 @@ bool ThermalWatcher::threadLoop() {
     std::set<std::string> sensors;
 
     int timeout = (thermal_triggered_ || is_polling_) ? kMinPollIntervalMs : kUeventPollTimeoutMs;
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - last_update_time_);
+    timeout = std::max<int64_t>(0, timeout - elapsed.count());
     if (looper_->pollOnce(timeout, &fd, nullptr, nullptr) >= 0) {
+        if (fd == cdev_epoll_fd_.get()) {
+            std::map<std::string, std::string> cdev_states;
+            parseCdevEvents(&cdev_states);
+            if (!cdev_states.empty() && cdev_cb_) {
+                cdev_cb_(cdev_states);
+            }
+            return true;
+        }
         if (fd != uevent_fd_.get()) {
             return true;
         }
@@ -159,6 +267,7 @@ bool ThermalWatcher::threadLoop() {
         }
     }
     thermal_triggered_ = cb_(sensors);
+    last_update_time_ = std::chrono::steady_clock::now();
     return true;
 }
 
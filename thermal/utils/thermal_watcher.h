@@ -20,11 +20,14 @@
 #include <condition_variable>
 #include <future>
 #include <list>
+#include <map>
 #include <mutex>
 #include <set>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include <android-base/unique_fd.h>
@@ -39,12 +42,15 @@ namespace implementation {
 
 using android::base::unique_fd;
 using WatcherCallback = std::function<bool(const std::set<std::string> &name)>;
+// Called with the new cur_state of the cooling devices which signaled a change, by name.
+using CdevWatcherCallback =
+        std::function<void(const std::map<std::string, std::string> &cdev_states)>;
 
 // A helper class for monitoring thermal files changes.
 class ThermalWatcher : public ::android::Thread {
   public:
-    ThermalWatcher(const WatcherCallback &cb)
-        : Thread(false), cb_(cb), looper_(new Looper(true)) {}
+    ThermalWatcher(const WatcherCallback &cb, const CdevWatcherCallback &cdev_cb)
+        : Thread(false), cb_(cb), cdev_cb_(cdev_cb), looper_(new Looper(true)) {}
     ~ThermalWatcher() = default;
 
     // Disallow copy and assign.
@@ -55,9 +61,12 @@ class ThermalWatcher : public ::android::Thread {
     bool startWatchingDeviceFiles();
     // Give the file watcher a list of files to start watching. This helper
     // class will by default wait for modifications to the file with a looper.
+    // cdev_to_watch maps cooling device names to their cur_state path, whose changes are
+    // reported to cdev_cb if the driver calls sysfs_notify() on them.
     // This should be called before starting watcher thread.
     void registerFilesToWatch(const std::set<std::string> &sensors_to_watch,
-                              const std::set<std::string> &cdev_to_watch, bool uevent_monitor);
+                              const std::map<std::string, std::string> &cdev_to_watch,
+                              bool uevent_monitor);
     // Wake up the looper thus the worker thread, immediately. This can be called
     // in any thread.
     void wake();
@@ -71,16 +80,22 @@ class ThermalWatcher : public ::android::Thread {
 
     // Parse uevent message
     void parseUevent(std::set<std::string> *sensor_name);
+    // Read the cur_state of the notified cooling devices, which also re-arms the notification.
+    void parseCdevEvents(std::map<std::string, std::string> *cdev_states);
 
-    // Maps watcher filer descriptor to watched file path.
-    std::unordered_map<int, std::string> watch_to_file_path_map_;
+    // Maps cur_state file descriptors to cooling device names.
+    std::unordered_map<int, std::string> cdev_fd_to_name_map_;
     std::vector<android::base::unique_fd> fds_;
+    // epoll set of the cur_state fds waiting for EPOLLPRI. Looper only polls for POLLIN, which
+    // sysfs files always report, so the set is added to the looper instead of the files.
+    android::base::unique_fd cdev_epoll_fd_;
 
     // The callback function. Called whenever thermal uevent is seen.
     // The function passed in should expect a string in the form (type).
     // Where type is the name of the thermal zone that trigger a uevent notification.
     // Callback will return thermal trigger status for next polling decision.
     const WatcherCallback cb_;
+    const CdevWatcherCallback cdev_cb_;
 
     sp<Looper> looper_;
 
@@ -88,10 +103,14 @@ class ThermalWatcher : public ::android::Thread {
     android::base::unique_fd uevent_fd_;
     // Sensor list which monitor flag is enabled.
     std::set<std::string> monitored_sensors_;
+    // Hash of monitored_sensors_ names for uevent parsing.
+    std::unordered_set<std::string_view> monitored_sensor_names_;
     // Flag to point out if any sensor across the first threshold.
     bool thermal_triggered_;
     // Flag to point out if device can support uevent notify.
     bool is_polling_;
+    // Time of the last cb_ call, cooling device events do not postpone the next one.
+    std::chrono::steady_clock::time_point last_update_time_;
 };
 
 }  // namespace implementation